@@ -5,5 +5,7 @@
 #include "zeroerr/color.h"
 #include "zeroerr/dbg.h"
 #include "zeroerr/log.h"
+#include "zeroerr/logfile.h"
+#include "zeroerr/metric.h"
 #include "zeroerr/print.h"
 #include "zeroerr/unittest.h"
\ No newline at end of file
@@ -3,13 +3,16 @@
 #include "zeroerr/internal/config.h"
 
 #include "zeroerr/format.h"
+#include "zeroerr/internal/compare.h"
 #include "zeroerr/internal/debugbreak.h"
 #include "zeroerr/internal/decomposition.h"
+#include "zeroerr/internal/threadsafe.h"
 #include "zeroerr/print.h"
 
 #include <cstdint>
 #include <exception>
 #include <iostream>
+#include <vector>
 
 ZEROERR_SUPPRESS_COMMON_WARNINGS_PUSH
 
@@ -27,12 +30,14 @@ ZEROERR_SUPPRESS_COMMON_WARNINGS_PUSH
  * 
  * This macro defines the default printer for assertion messages.
  * It prints the assertion message in different colors based on the assertion level.
+ * The pattern is a string literal, its placeholders are checked against the arguments
+ * at compile time by ZEROERR_FMT.
  * 
  * The macro can be overridden by defining ZEROERR_PRINT_ASSERT_DEFAULT_PRINTER before
  * including this header. (Or undefine it and implement your own printer.)
  */
 #ifndef ZEROERR_PRINT_ASSERT_DEFAULT_PRINTER
-#define ZEROERR_PRINT_ASSERT_DEFAULT_PRINTER(cond, level, ...)                    \
+#define ZEROERR_PRINT_ASSERT_DEFAULT_PRINTER(cond, level, pattern, ...)           \
     do {                                                                          \
         if (cond) {                                                               \
             switch (zeroerr::assert_level::ZEROERR_CAT(level, _l)) {              \
@@ -46,7 +51,8 @@ ZEROERR_SUPPRESS_COMMON_WARNINGS_PUSH
                     std::cerr << zeroerr::FgMagenta << "FATAL" << zeroerr::Reset; \
                     break;                                                        \
             }                                                                     \
-            std::cerr << zeroerr::format(__VA_ARGS__) << std::endl;               \
+            std::cerr << zeroerr::format(ZEROERR_FMT(pattern), __VA_ARGS__)       \
+                      << std::endl;                                               \
         }                                                                         \
     } while (0)
 #endif
@@ -58,23 +64,34 @@ ZEROERR_CLANG_SUPPRESS_WARNING_WITH_PUSH("-Wgnu-zero-variadic-macro-arguments")
 #define ZEROERR_PRINT_ASSERT(cond, level, pattern, ...)                                    \
     ZEROERR_PRINT_ASSERT_DEFAULT_PRINTER(cond, level, " Assertion Failed:\n{msg}" pattern, \
                                          assertion_data.log(), ##__VA_ARGS__)
+
+// In production mode the failure is a structured record, each part is a field of the log
+#define ZEROERR_PRINT_PRODUCTION_ASSERT(level, pattern, ...)                              \
+    ZEROERR_PRINT_ASSERT_DEFAULT_PRINTER(                                                 \
+        true, level, " Assertion Failed: {cond} expands to {expr} at {file}:{line}" pattern, \
+        assertion_data.cond, assertion_data.message, assertion_data.file, assertion_data.line, \
+        ##__VA_ARGS__)
 ZEROERR_CLANG_SUPPRESS_WARNING_POP
 
-#define ZEROERR_ASSERT_EXP(cond, level, expect_throw, is_false, ...)                             \
+// The assertion of a result convertible to ExprResult, the text is the condition to print
+#define ZEROERR_TEST_ASSERT_RESULT(result, text, level, expect_throw, is_false, ...)             \
     ZEROERR_FUNC_SCOPE_BEGIN {                                                                   \
-        zeroerr::assert_info info{zeroerr::assert_level::ZEROERR_CAT(level, _l),                 \
-                                  zeroerr::assert_throw::expect_throw, is_false};                \
-                                                                                                 \
-        zeroerr::AssertionData assertion_data(__FILE__, __LINE__, #cond, info);                  \
+        static zeroerr::AssertionSite assertion_site(                                            \
+            __FILE__, __LINE__, text,                                                            \
+            zeroerr::assert_info{zeroerr::assert_level::ZEROERR_CAT(level, _l),                  \
+                                 zeroerr::assert_throw::expect_throw, is_false});                \
+        zeroerr::AssertionData assertion_data(assertion_site);                                   \
         try {                                                                                    \
-            assertion_data.setResult(zeroerr::ExpressionDecomposer() << cond);                   \
+            assertion_data.setResult(result);                                                    \
         } catch (const std::exception& e) {                                                      \
             assertion_data.setException(e);                                                      \
         }                                                                                        \
-        zeroerr::detail::context_helper<                                                         \
+        assertion_site.count(assertion_data.passed);                                             \
+        const auto& assertion_scope = zeroerr::detail::context_helper<                           \
             decltype(_ZEROERR_TEST_CONTEXT),                                                     \
             std::is_same<decltype(_ZEROERR_TEST_CONTEXT),                                        \
                          const bool>::value>::setContext(assertion_data, _ZEROERR_TEST_CONTEXT); \
+        (void)assertion_scope;                                                                   \
         ZEROERR_PRINT_ASSERT(assertion_data.passed == false, level, "" __VA_ARGS__);             \
         if (false) debug_break();                                                                \
         assertion_data();                                                                        \
@@ -82,24 +99,32 @@ ZEROERR_CLANG_SUPPRESS_WARNING_POP
     }                                                                                            \
     ZEROERR_FUNC_SCOPE_END
 
+#define ZEROERR_TEST_ASSERT_EXP(cond, level, expect_throw, is_false, ...)                   \
+    ZEROERR_TEST_ASSERT_RESULT(zeroerr::ExpressionDecomposer() << cond, #cond, level, \
+                               expect_throw, is_false, __VA_ARGS__)
+
 
-#define ZEROERR_ASSERT_CMP(lhs, op, rhs, level, expect_throw, is_false, ...)                     \
+#define ZEROERR_TEST_ASSERT_CMP(lhs, op, rhs, level, expect_throw, is_false, ...)                \
     ZEROERR_FUNC_SCOPE_BEGIN {                                                                   \
-        zeroerr::assert_info info{zeroerr::assert_level::ZEROERR_CAT(level, _l),                 \
-                                  zeroerr::assert_throw::expect_throw, is_false};                \
-                                                                                                 \
-        zeroerr::Printer print;                                                                  \
-        print.isQuoted = false;                                                                  \
-        zeroerr::AssertionData assertion_data(__FILE__, __LINE__, #lhs " " #op " " #rhs, info);  \
+        static zeroerr::AssertionSite assertion_site(                                            \
+            __FILE__, __LINE__, #lhs " " #op " " #rhs,                                           \
+            zeroerr::assert_info{zeroerr::assert_level::ZEROERR_CAT(level, _l),                  \
+                                 zeroerr::assert_throw::expect_throw, is_false});                \
+        zeroerr::AssertionData assertion_data(assertion_site);                                   \
         try {                                                                                    \
-            assertion_data.setResult({(lhs)op(rhs), print(lhs, #op, rhs)});                      \
+            const auto& _zeroerr_lhs = (lhs);                                                    \
+            const auto& _zeroerr_rhs = (rhs);                                                    \
+            auto        _zeroerr_cmp = zeroerr::make_compare(_zeroerr_lhs, #op, _zeroerr_rhs);   \
+            assertion_data.setResult(_zeroerr_cmp.result(_zeroerr_lhs op _zeroerr_rhs));         \
         } catch (const std::exception& e) {                                                      \
             assertion_data.setException(e);                                                      \
         }                                                                                        \
-        zeroerr::detail::context_helper<                                                         \
+        assertion_site.count(assertion_data.passed);                                             \
+        const auto& assertion_scope = zeroerr::detail::context_helper<                           \
             decltype(_ZEROERR_TEST_CONTEXT),                                                     \
             std::is_same<decltype(_ZEROERR_TEST_CONTEXT),                                        \
                          const bool>::value>::setContext(assertion_data, _ZEROERR_TEST_CONTEXT); \
+        (void)assertion_scope;                                                                   \
         ZEROERR_PRINT_ASSERT(assertion_data.passed == false, level, "" __VA_ARGS__);             \
         if (false) debug_break();                                                                \
         assertion_data();                                                                        \
@@ -108,6 +133,48 @@ ZEROERR_CLANG_SUPPRESS_WARNING_POP
     ZEROERR_FUNC_SCOPE_END
 
 
+// The production mode only evaluates the condition on the hot path. The expression is
+// decomposed as in the test mode so that `a < b < c` has the same meaning, but nothing is
+// printed and no AssertionData is created unless the assertion fails. The test context is
+// not updated. The assertions expecting an exception are the same as in the test mode.
+#define ZEROERR_PRODUCTION_ASSERT_IMPL(result, text, level, is_false, ...)                         \
+    zeroerr::detail::checkProduction(                                                              \
+        result, is_false,                                                                          \
+        [&](zeroerr::ExprResult& _zeroerr_result) -> bool {                                        \
+            static zeroerr::AssertionSite assertion_site(                                          \
+                __FILE__, __LINE__, text,                                                          \
+                zeroerr::assert_info{zeroerr::assert_level::ZEROERR_CAT(level, _l),                \
+                                     zeroerr::assert_throw::no_throw, is_false});                  \
+            zeroerr::AssertionData assertion_data(assertion_site);                                 \
+            assertion_data.passed  = false;                                                        \
+            assertion_data.message = _zeroerr_result.str();                                        \
+            assertion_site.count(false);                                                           \
+            ZEROERR_PRINT_PRODUCTION_ASSERT(level, "" __VA_ARGS__);                                \
+            if (false) debug_break();                                                              \
+            assertion_data();                                                                      \
+            return false;                                                                          \
+        })
+
+#define ZEROERR_PRODUCTION_ASSERT_EXP_no_throw(cond, level, expect_throw, is_false, ...) \
+    ZEROERR_PRODUCTION_ASSERT_IMPL(zeroerr::ExpressionDecomposer() << cond, #cond, level, is_false, \
+                                   __VA_ARGS__)
+#define ZEROERR_PRODUCTION_ASSERT_EXP_throws ZEROERR_TEST_ASSERT_EXP
+
+#ifdef ZEROERR_PRODUCTION_ASSERT
+#define ZEROERR_ASSERT_EXP(cond, level, expect_throw, is_false, ...)                   \
+    ZEROERR_EXPAND(ZEROERR_CAT(ZEROERR_PRODUCTION_ASSERT_EXP_, expect_throw)(          \
+        cond, level, expect_throw, is_false, __VA_ARGS__))
+#define ZEROERR_ASSERT_CMP(lhs, op, rhs, level, expect_throw, is_false, ...)           \
+    ZEROERR_PRODUCTION_ASSERT_IMPL(zeroerr::ExpressionDecomposer() << (lhs) op (rhs),     \
+                                   #lhs " " #op " " #rhs, level, is_false, __VA_ARGS__)
+#define ZEROERR_ASSERT_RESULT(result, text, level, expect_throw, is_false, ...) \
+    ZEROERR_PRODUCTION_ASSERT_IMPL(result, text, level, is_false, __VA_ARGS__)
+#else
+#define ZEROERR_ASSERT_EXP    ZEROERR_TEST_ASSERT_EXP
+#define ZEROERR_ASSERT_CMP    ZEROERR_TEST_ASSERT_CMP
+#define ZEROERR_ASSERT_RESULT ZEROERR_TEST_ASSERT_RESULT
+#endif
+
 #ifdef ZEROERR_NO_ASSERT
 
 #define CHECK(...)
@@ -141,6 +208,20 @@ ZEROERR_CLANG_SUPPRESS_WARNING_POP
 #define ASSERT_GT(...)
 #define ASSERT_GE(...)
 
+#define CHECK_SAMPLED(...)
+#define REQUIRE_SAMPLED(...)
+#define ASSERT_SAMPLED(...)
+
+#define CHECK_ARRAY_EQ(...)
+#define CHECK_ALL_CLOSE(...)
+#define CHECK_BYTES_EQ(...)
+#define REQUIRE_ARRAY_EQ(...)
+#define REQUIRE_ALL_CLOSE(...)
+#define REQUIRE_BYTES_EQ(...)
+#define ASSERT_ARRAY_EQ(...)
+#define ASSERT_ALL_CLOSE(...)
+#define ASSERT_BYTES_EQ(...)
+
 #else
 // clang-format off
 ZEROERR_CLANG_SUPPRESS_WARNING_WITH_PUSH("-Wgnu-zero-variadic-macro-arguments")
@@ -205,6 +286,46 @@ ZEROERR_CLANG_SUPPRESS_WARNING_WITH_PUSH("-Wgnu-zero-variadic-macro-arguments")
 #define ASSERT_GT(...)  ZEROERR_SUPPRESS_VARIADIC_MACRO ZEROERR_EXPAND(ZEROERR_ASSERT_GT(__VA_ARGS__)) ZEROERR_SUPPRESS_VARIADIC_MACRO_POP
 #define ASSERT_GE(...)  ZEROERR_SUPPRESS_VARIADIC_MACRO ZEROERR_EXPAND(ZEROERR_ASSERT_GE(__VA_ARGS__)) ZEROERR_SUPPRESS_VARIADIC_MACRO_POP
 
+// The sampled assertions are only evaluated for a fraction (rate) of the times they are reached
+#ifdef ZEROERR_DISABLE_ASSERTS_RETURN_VALUES
+#define ZEROERR_SAMPLED(rate, assertion) do { if (zeroerr::detail::sampleAssertion(rate)) assertion; } while (0)
+#else
+#define ZEROERR_SAMPLED(rate, assertion) (zeroerr::detail::sampleAssertion(rate) ? assertion : true)
+#endif
+
+#define ZEROERR_CHECK_SAMPLED(rate, ...)   ZEROERR_SAMPLED(rate, ZEROERR_EXPAND(ZEROERR_CHECK(__VA_ARGS__)))
+#define ZEROERR_REQUIRE_SAMPLED(rate, ...) ZEROERR_SAMPLED(rate, ZEROERR_EXPAND(ZEROERR_REQUIRE(__VA_ARGS__)))
+#define ZEROERR_ASSERT_SAMPLED(rate, ...)  ZEROERR_SAMPLED(rate, ZEROERR_EXPAND(ZEROERR_ASSERT(__VA_ARGS__)))
+
+#define CHECK_SAMPLED(...)   ZEROERR_SUPPRESS_VARIADIC_MACRO ZEROERR_EXPAND(ZEROERR_CHECK_SAMPLED(__VA_ARGS__)) ZEROERR_SUPPRESS_VARIADIC_MACRO_POP
+#define REQUIRE_SAMPLED(...) ZEROERR_SUPPRESS_VARIADIC_MACRO ZEROERR_EXPAND(ZEROERR_REQUIRE_SAMPLED(__VA_ARGS__)) ZEROERR_SUPPRESS_VARIADIC_MACRO_POP
+#define ASSERT_SAMPLED(...)  ZEROERR_SUPPRESS_VARIADIC_MACRO ZEROERR_EXPAND(ZEROERR_ASSERT_SAMPLED(__VA_ARGS__)) ZEROERR_SUPPRESS_VARIADIC_MACRO_POP
+
+// Bulk comparisons of contiguous ranges, only the first mismatches are printed on failure
+#define ZEROERR_ARRAY_EQ(a, b, level, ...)              ZEROERR_ASSERT_RESULT(zeroerr::detail::compareArrays(a, b), #a " == " #b, level, no_throw, false, __VA_ARGS__)
+#define ZEROERR_ALL_CLOSE(a, b, rtol, atol, level, ...) ZEROERR_ASSERT_RESULT(zeroerr::detail::compareAllClose(a, b, rtol, atol), #a " ~= " #b, level, no_throw, false, __VA_ARGS__)
+#define ZEROERR_BYTES_EQ(a, b, size, level, ...)        ZEROERR_ASSERT_RESULT(zeroerr::detail::compareBytes(a, b, size), #a " == " #b, level, no_throw, false, __VA_ARGS__)
+
+#define ZEROERR_CHECK_ARRAY_EQ(a, b, ...)                ZEROERR_ARRAY_EQ(a, b, ZEROERR_WARN, __VA_ARGS__)
+#define ZEROERR_CHECK_ALL_CLOSE(a, b, rtol, atol, ...)   ZEROERR_ALL_CLOSE(a, b, rtol, atol, ZEROERR_WARN, __VA_ARGS__)
+#define ZEROERR_CHECK_BYTES_EQ(a, b, size, ...)          ZEROERR_BYTES_EQ(a, b, size, ZEROERR_WARN, __VA_ARGS__)
+#define ZEROERR_REQUIRE_ARRAY_EQ(a, b, ...)              ZEROERR_ARRAY_EQ(a, b, ZEROERR_ERROR, __VA_ARGS__)
+#define ZEROERR_REQUIRE_ALL_CLOSE(a, b, rtol, atol, ...) ZEROERR_ALL_CLOSE(a, b, rtol, atol, ZEROERR_ERROR, __VA_ARGS__)
+#define ZEROERR_REQUIRE_BYTES_EQ(a, b, size, ...)        ZEROERR_BYTES_EQ(a, b, size, ZEROERR_ERROR, __VA_ARGS__)
+#define ZEROERR_ASSERT_ARRAY_EQ(a, b, ...)               ZEROERR_ARRAY_EQ(a, b, ZEROERR_FATAL, __VA_ARGS__)
+#define ZEROERR_ASSERT_ALL_CLOSE(a, b, rtol, atol, ...)  ZEROERR_ALL_CLOSE(a, b, rtol, atol, ZEROERR_FATAL, __VA_ARGS__)
+#define ZEROERR_ASSERT_BYTES_EQ(a, b, size, ...)         ZEROERR_BYTES_EQ(a, b, size, ZEROERR_FATAL, __VA_ARGS__)
+
+#define CHECK_ARRAY_EQ(...)    ZEROERR_SUPPRESS_VARIADIC_MACRO ZEROERR_EXPAND(ZEROERR_CHECK_ARRAY_EQ(__VA_ARGS__)) ZEROERR_SUPPRESS_VARIADIC_MACRO_POP
+#define CHECK_ALL_CLOSE(...)   ZEROERR_SUPPRESS_VARIADIC_MACRO ZEROERR_EXPAND(ZEROERR_CHECK_ALL_CLOSE(__VA_ARGS__)) ZEROERR_SUPPRESS_VARIADIC_MACRO_POP
+#define CHECK_BYTES_EQ(...)    ZEROERR_SUPPRESS_VARIADIC_MACRO ZEROERR_EXPAND(ZEROERR_CHECK_BYTES_EQ(__VA_ARGS__)) ZEROERR_SUPPRESS_VARIADIC_MACRO_POP
+#define REQUIRE_ARRAY_EQ(...)  ZEROERR_SUPPRESS_VARIADIC_MACRO ZEROERR_EXPAND(ZEROERR_REQUIRE_ARRAY_EQ(__VA_ARGS__)) ZEROERR_SUPPRESS_VARIADIC_MACRO_POP
+#define REQUIRE_ALL_CLOSE(...) ZEROERR_SUPPRESS_VARIADIC_MACRO ZEROERR_EXPAND(ZEROERR_REQUIRE_ALL_CLOSE(__VA_ARGS__)) ZEROERR_SUPPRESS_VARIADIC_MACRO_POP
+#define REQUIRE_BYTES_EQ(...)  ZEROERR_SUPPRESS_VARIADIC_MACRO ZEROERR_EXPAND(ZEROERR_REQUIRE_BYTES_EQ(__VA_ARGS__)) ZEROERR_SUPPRESS_VARIADIC_MACRO_POP
+#define ASSERT_ARRAY_EQ(...)   ZEROERR_SUPPRESS_VARIADIC_MACRO ZEROERR_EXPAND(ZEROERR_ASSERT_ARRAY_EQ(__VA_ARGS__)) ZEROERR_SUPPRESS_VARIADIC_MACRO_POP
+#define ASSERT_ALL_CLOSE(...)  ZEROERR_SUPPRESS_VARIADIC_MACRO ZEROERR_EXPAND(ZEROERR_ASSERT_ALL_CLOSE(__VA_ARGS__)) ZEROERR_SUPPRESS_VARIADIC_MACRO_POP
+#define ASSERT_BYTES_EQ(...)   ZEROERR_SUPPRESS_VARIADIC_MACRO ZEROERR_EXPAND(ZEROERR_ASSERT_BYTES_EQ(__VA_ARGS__)) ZEROERR_SUPPRESS_VARIADIC_MACRO_POP
+
 ZEROERR_CLANG_SUPPRESS_WARNING_POP
 // clang-format on
 #endif
@@ -234,6 +355,77 @@ struct assert_info {
 };
 
 
+/**
+ * @brief AssertionSite is the static meta data of an assertion, created once per site.
+ * @details The condition text is cleaned once when the site is first reached, and the
+ * counters record how many times the assertion is evaluated and failed. All sites are
+ * linked in a list which can be read by getAssertionSites().
+ */
+struct AssertionSite {
+    const char* file;  // file name
+    unsigned    line;  // line number
+    std::string cond;  // the condition of the assertion
+    assert_info info;  // assert info
+
+    ZEROERR_ATOMIC(uint64_t) evaluations;
+    ZEROERR_ATOMIC(uint64_t) failures;  // failed assertions of ERROR and FATAL level
+    ZEROERR_ATOMIC(uint64_t) warnings;  // failed assertions of WARN level
+    AssertionSite* next = nullptr;
+
+    AssertionSite(const char* file, unsigned line, const char* cond, assert_info info)
+        : file(file), line(line), cond(cond), info(info), evaluations(0), failures(0), warnings(0) {
+        static const std::string pattern = "zeroerr::ExpressionDecomposer() << ";
+        for (size_t pos = this->cond.find(pattern); pos != std::string::npos;
+             pos        = this->cond.find(pattern, pos))
+            this->cond.erase(pos, pattern.size());
+
+        // the same site can be first reached by several threads, push it without a lock
+#ifdef ZEROERR_NO_THREAD_SAFE
+        next   = head();
+        head() = this;
+#else
+        next = head().load(std::memory_order_relaxed);
+        while (!head().compare_exchange_weak(next, this, std::memory_order_release,
+                                             std::memory_order_relaxed)) {
+        }
+#endif
+    }
+
+    AssertionSite(const AssertionSite&)            = delete;
+    AssertionSite& operator=(const AssertionSite&) = delete;
+
+    void count(bool passed) {
+#ifdef ZEROERR_NO_THREAD_SAFE
+        evaluations++;
+        if (!passed) (info.level == assert_level::ZEROERR_WARN_l ? warnings : failures)++;
+#else
+        evaluations.fetch_add(1, std::memory_order_relaxed);
+        if (!passed)
+            (info.level == assert_level::ZEROERR_WARN_l ? warnings : failures)
+                .fetch_add(1, std::memory_order_relaxed);
+#endif
+    }
+
+    static ZEROERR_ATOMIC(AssertionSite*) & head() {
+        static ZEROERR_ATOMIC(AssertionSite*) list(nullptr);
+        return list;
+    }
+};
+
+/**
+ * @brief get all the assertion sites reached so far, the latest reached site is the first
+ */
+inline std::vector<const AssertionSite*> getAssertionSites() {
+    std::vector<const AssertionSite*> sites;
+#ifdef ZEROERR_NO_THREAD_SAFE
+    const AssertionSite* p = AssertionSite::head();
+#else
+    const AssertionSite* p = AssertionSite::head().load(std::memory_order_acquire);
+#endif
+    for (; p; p = p->next) sites.push_back(p);
+    return sites;
+}
+
 /**
  * @brief AssertionData is a struct that contains all the information of an assertion.
  *       It will be thrown as an exception when the assertion failed.
@@ -244,24 +436,18 @@ struct AssertionData : std::exception {
     assert_info info;     // assert info
     bool        passed;   // if the assertion passed
     std::string message;  // the message of the assertion
-    std::string cond;     // the condition of the assertion
-
-    AssertionData(const char* file, unsigned line, const char* cond, assert_info info)
-        : file(file), line(line), info(info) {
-        static std::string pattern = "zeroerr::ExpressionDecomposer() << ";
-        std::string        cond_str(cond);
-        size_t             pos = cond_str.find(pattern);
-        if (pos != std::string::npos) cond_str.replace(pos, pos + pattern.size(), "");
-        this->cond = cond_str;
-    }
+    const char* cond;     // the condition of the assertion, owned by the site
 
+    AssertionData(const AssertionSite& site)
+        : file(site.file), line(site.line), info(site.info), cond(site.cond.c_str()) {}
+
+    // the operands are printed only if the assertion failed
     void setResult(ExprResult&& result) {
-        ExprResult r(std::move(result));
         if (info.is_false)
-            passed = !r.res;
+            passed = !result.res;
         else
-            passed = r.res;
-        message = r.decomp;
+            passed = result.res;
+        if (!passed) message = result.str();
     }
 
     void setException(const std::exception& e) {
@@ -286,6 +472,31 @@ struct AssertionData : std::exception {
 };
 
 namespace detail {
+
+// the failure path of checkProduction, it is kept out of line so the hot path stays small
+template <typename F>
+ZEROERR_COLD bool checkProductionFailed(ExprResult& result, F& fail) { return fail(result); }
+
+// the hot path of an assertion in production mode, `fail` is only called on failure
+template <typename F>
+inline bool checkProduction(ExprResult&& result, bool is_false, F&& fail) {
+    if (ZEROERR_LIKELY(result.res != is_false)) return true;
+    return checkProductionFailed(result, fail);
+}
+
+// decide whether a sampled assertion is evaluated, by a per-thread xorshift generator
+inline bool sampleAssertion(double rate) {
+    if (rate >= 1) return true;
+    if (rate <= 0) return false;
+    static thread_local uint64_t state = 0;
+    if (state == 0)  // seed each thread differently
+        state = (reinterpret_cast<uintptr_t>(&state) | 1) * 0x9E3779B97F4A7C15ull;
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return static_cast<double>(state >> 11) * (1.0 / 9007199254740992.0) < rate;
+}
+
 // This struct is used for handle constexpr if in C++11
 // https://stackoverflow.com/questions/43587405/constexpr-if-alternative
 template <typename T, bool>
@@ -293,23 +504,25 @@ struct context_helper;
 
 template <typename T>
 struct context_helper<T, true> {
-    static void setContext(AssertionData& data, T) {
-        if (data.passed) return;
-    }
+    static bool setContext(AssertionData&, T) { return false; }
 };
 
+// The assertions of the thread running the test case are counted in place. The returned scope
+// captures the output of a failed assertion in another thread until the assertion ends.
 template <typename T>
 struct context_helper<T, false> {
-    static void setContext(AssertionData& data, T ctx) {
+    static auto setContext(AssertionData& data, T ctx) -> decltype(ctx->countInThread(data)) {
+        if (ctx->otherThread()) return ctx->countInThread(data);
         if (data.passed) {
             ctx->passed_as++;
-            return;
+            return {};
         }
         switch (data.info.level) {
             case assert_level::ZEROERR_FATAL_l:
             case assert_level::ZEROERR_ERROR_l: ctx->failed_as++; break;
             case assert_level::ZEROERR_WARN_l:  ctx->warning_as++; break;
         }
+        return {};
     }
 };
 }  // namespace detail
@@ -17,7 +17,7 @@ ZEROERR_SUPPRESS_COMMON_WARNINGS_PUSH
 #define ZEROERR_CREATE_BENCHMARK_FUNC(function, name, ...)                              \
     static void                     function(zeroerr::TestContext*);                    \
     static zeroerr::detail::regTest ZEROERR_NAMEGEN(_zeroerr_reg)(                      \
-        {name, __FILE__, __LINE__, function, {__VA_ARGS__}}, zeroerr::TestType::bench); \
+        name, __FILE__, __LINE__, function, {__VA_ARGS__}, zeroerr::TestType::bench);   \
     static void function(ZEROERR_UNUSED(zeroerr::TestContext* _ZEROERR_TEST_CONTEXT))
 
 #define BENCHMARK(...) \
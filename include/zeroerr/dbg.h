@@ -4,6 +4,7 @@
 #include "zeroerr/color.h"
 #include "zeroerr/print.h"
 
+#include <cstring>
 #include <iostream>
 #include <tuple>  // for std::get and std::tie
 
@@ -44,9 +45,8 @@ auto get_last(Args&&... args) -> typename last<Args...>::type {
 template <typename... T>
 auto DebugExpr(const char* file, unsigned line, const char* func, const char* exprs, T... t) ->
     typename last<T...>::type {
-    std::string fileName(file);
-    auto        p = fileName.find_last_of('/');
-    if (p != std::string::npos) fileName = fileName.substr(p + 1);
+    const char* fileName = std::strrchr(file, '/');
+    fileName             = fileName ? fileName + 1 : file;
 
     std::cerr << Dim << "[" << fileName << ":" << line << " " << func << "] " << Reset;
     std::cerr << FgCyan << exprs << Reset << " = ";
@@ -54,7 +54,7 @@ auto DebugExpr(const char* file, unsigned line, const char* func, const char* ex
     print.line_break = "";
     print(t...);
     std::cerr << " (" << FgGreen;
-    std::string typenames[] = {print.type(t)...};
+    const char* typenames[] = {print.typeName(t)...};
     for (unsigned i = 0; i < sizeof...(T); ++i) {
         if (i != 0) std::cerr << ", ";
         std::cerr << typenames[i];
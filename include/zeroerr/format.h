@@ -1,51 +1,221 @@
 #pragma once
+#include "zeroerr/internal/config.h"
+
 #include "zeroerr/print.h"
 
+#include <cstdint>
 #include <sstream>
 #include <string>
+#include <type_traits>
 
 namespace zeroerr {
 
+namespace detail {
+
+// append a value to the buffer in the same format as Printer, without a stream
+extern void format_int(std::string& out, int64_t value);
+extern void format_uint(std::string& out, uint64_t value);
+extern void format_float(std::string& out, double value);
+
+#define ZEROERR_IS_FORMAT_INT                                                         \
+    (std::is_integral<T>::value && sizeof(T) > 1 && !std::is_same<T, bool>::value && \
+     !std::is_same<T, wchar_t>::value && !std::is_same<T, char16_t>::value &&         \
+     !std::is_same<T, char32_t>::value)
+#define ZEROERR_IS_FORMAT_FLOAT (std::is_same<T, float>::value || std::is_same<T, double>::value)
+#define ZEROERR_IS_FORMAT_CSTR \
+    (std::is_same<T, const char*>::value || std::is_same<T, char*>::value)
+#define ZEROERR_IS_FORMAT_CHAR_ARRAY \
+    (std::is_array<T>::value &&      \
+     std::is_same<typename std::remove_cv<typename std::remove_extent<T>::type>::type, char>::value)
+#define ZEROERR_IS_FORMAT_FAST                                                           \
+    (ZEROERR_IS_FORMAT_INT || ZEROERR_IS_FORMAT_FLOAT || std::is_same<T, bool>::value || \
+     std::is_same<T, std::string>::value || ZEROERR_IS_FORMAT_CSTR ||                   \
+     ZEROERR_IS_FORMAT_CHAR_ARRAY)
+
+ZEROERR_ENABLE_IF(ZEROERR_IS_FORMAT_INT && std::is_signed<T>::value)
+format_arg(std::string& out, const T& v) { format_int(out, v); }
+
+ZEROERR_ENABLE_IF(ZEROERR_IS_FORMAT_INT && std::is_unsigned<T>::value)
+format_arg(std::string& out, const T& v) { format_uint(out, v); }
+
+ZEROERR_ENABLE_IF(ZEROERR_IS_FORMAT_FLOAT)
+format_arg(std::string& out, const T& v) { format_float(out, v); }
+
+ZEROERR_ENABLE_IF((std::is_same<T, bool>::value))
+format_arg(std::string& out, const T& v) { out += v ? "true" : "false"; }
+
+ZEROERR_ENABLE_IF((std::is_same<T, std::string>::value))
+format_arg(std::string& out, const T& v) { out += v; }
+
+ZEROERR_ENABLE_IF(ZEROERR_IS_FORMAT_CSTR)
+format_arg(std::string& out, const T& v) { out += v ? v : "nullptr"; }
+
+ZEROERR_ENABLE_IF(ZEROERR_IS_FORMAT_CHAR_ARRAY)
+format_arg(std::string& out, const T& v) { out += v; }
+
+// the other values are printed by a compact Printer straight into the buffer
+ZEROERR_ENABLE_IF(!ZEROERR_IS_FORMAT_FAST)
+format_arg(std::string& out, const T& v) {
+    Printer print(out);
+    print.isQuoted   = false;
+    print.isCompact  = true;
+    print.line_break = "";
+    print(v);
+}
+
+// a type erased reference to an argument of format()
+struct FormatArg {
+    template <typename T>
+    static void call(std::string& out, const void* v) {
+        format_arg(out, *static_cast<const T*>(v));
+    }
+
+    const void* value;
+    void (*print)(std::string& out, const void* value);
+};
+
+#undef ZEROERR_IS_FORMAT_FLOAT
+#undef ZEROERR_IS_FORMAT_CSTR
+#undef ZEROERR_IS_FORMAT_CHAR_ARRAY
+#undef ZEROERR_IS_FORMAT_FAST
+#undef ZEROERR_IS_FORMAT_INT
+
+extern void format_args(std::string& out, const char* fmt, const FormatArg* args, unsigned n);
+
+// The format string is scanned by constexpr functions the same way as format_args: a
+// placeholder is from '{' to the next '}', or a single '}'. An unclosed '{' ends the string.
+
+// the end of the text from i, it stops at a placeholder or the end of the string
+constexpr unsigned fmt_text_end(const char* s, unsigned i) {
+    return (s[i] == '\0' || s[i] == '{' || s[i] == '}') ? i : fmt_text_end(s, i + 1);
+}
+
+// the position after the placeholder at i, or the end of the string if it is not closed
+constexpr unsigned fmt_placeholder_end(const char* s, unsigned i) {
+    return s[i] == '\0' ? i : s[i] == '}' ? i + 1 : fmt_placeholder_end(s, i + 1);
+}
+
+constexpr bool fmt_is_placeholder(const char* s, unsigned i) {
+    return s[i] != '\0' && s[fmt_placeholder_end(s, i) - 1] == '}';
+}
+
+// the number of placeholders from i
+constexpr unsigned fmt_count(const char* s, unsigned i = 0) {
+    return fmt_is_placeholder(s, fmt_text_end(s, i))
+               ? 1 + fmt_count(s, fmt_placeholder_end(s, fmt_text_end(s, i)))
+               : 0;
+}
+
+// the start of the k-th text, the text after the (k-1)-th placeholder
+constexpr unsigned fmt_segment(const char* s, unsigned k, unsigned i = 0) {
+    return k == 0 ? i : fmt_segment(s, k - 1, fmt_placeholder_end(s, fmt_text_end(s, i)));
+}
+
+}  // namespace detail
+
+
+/**
+ * @brief FormatString is a format string split into texts and placeholders at compile time.
+ * @tparam N The number of placeholders
+ * @details Use ZEROERR_FMT to create it from a string literal. The text before each
+ * placeholder and after the last one is [begin[i], end[i]) of str.
+ */
+template <unsigned N>
+struct FormatString {
+    template <unsigned... I>
+    constexpr FormatString(const char* s, detail::seq<I...>)
+        : str(s),
+          begin{detail::fmt_segment(s, I)...},
+          end{detail::fmt_text_end(s, detail::fmt_segment(s, I))...} {}
+
+    const char* str;
+    unsigned    begin[N + 1];
+    unsigned    end[N + 1];
+};
+
+/**
+ * @brief ZEROERR_FMT creates a FormatString from a string literal
+ *
+ * Example:
+ *    format(ZEROERR_FMT("Hello, {name}!"), "John") -> "Hello, John!"
+ *
+ * The number of arguments is checked at compile time and the texts are appended without
+ * scanning the string again. The FormatString is a static constexpr variable, so the string
+ * is split by the compiler even without optimizations. The literal must not be longer than
+ * the constexpr recursion limit of the compiler (512 characters by default).
+ */
+#define ZEROERR_FMT(s)                                                              \
+    ([]() -> const zeroerr::FormatString<zeroerr::detail::fmt_count(s)>& {          \
+        static constexpr zeroerr::FormatString<zeroerr::detail::fmt_count(s)> fmt(  \
+            s, zeroerr::detail::gen_seq<zeroerr::detail::fmt_count(s) + 1>{});      \
+        return fmt;                                                                 \
+    }())
+
+namespace detail {
+
+template <unsigned N, unsigned... I, typename... T>
+void format_segments(std::string& out, const FormatString<N>& fmt, seq<I...>, const T&... args) {
+    int _[] = {0, (out.append(fmt.str + fmt.begin[I], fmt.end[I] - fmt.begin[I]),
+                   format_arg(out, args), 0)...};
+    (void)_;
+    out.append(fmt.str + fmt.begin[N], fmt.end[N] - fmt.begin[N]);
+}
+
+}  // namespace detail
+
+
+/**
+ * @brief Append a formatted string to the buffer
+ * @param out The buffer, the result is appended to it
+ * @param fmt The format string
+ * @param args The arguments
+ *
+ * Numbers, booleans and strings are written directly into the buffer, other types are
+ * printed by a Printer writing into the same buffer. A logger can keep a buffer and clear it
+ * for each message, so formatting does not allocate once the buffer has grown.
+ */
+template <typename... T>
+void format_to(std::string& out, const char* fmt, const T&... args) {
+    detail::FormatArg list[] = {{&args, &detail::FormatArg::call<T>}..., {nullptr, nullptr}};
+    detail::format_args(out, fmt, list, sizeof...(T));
+}
+
+/**
+ * @brief Append a string formatted by a FormatString to the buffer
+ */
+template <unsigned N, typename... T>
+void format_to(std::string& out, const FormatString<N>& fmt, const T&... args) {
+    static_assert(sizeof...(T) == N,
+                  "the number of arguments does not match the placeholders of the format string");
+    detail::format_segments(out, fmt, detail::gen_seq<N>{}, args...);
+}
 
 /**
  * @brief Format a string with arguments
  * @param fmt The format string
  * @param args The arguments
  * @return std::string The formatted string
- * 
+ *
  * This function is used to format a string with arguments. The format string
  * is a string with placeholders in the form of `{}`. You can pass any type of
  * arguments to this function and it will format the string accordingly.
- * 
+ *
  * Example:
  *    format("Hello, {name}!", "John") -> "Hello, John!"
- * 
+ *
  */
 template <typename... T>
-std::string format(const char* fmt, T... args) {
-    std::stringstream ss;
-    bool              parse_name = false;
-    Printer           print;
-
-    print.isQuoted         = false;
-    print.isCompact        = true;
-    print.line_break       = "";
-    std::string str_args[] = {print(args)...};
-
-    int j = 0;
-    for (const char* i = fmt; *i != '\0'; i++) {
-        switch (*i) {
-            case '{': parse_name = true; break;
-            case '}':
-                parse_name = false;
-                ss << str_args[j++];
-                break;
-            default:
-                if (!parse_name) ss << *i;
-                break;
-        }
-    }
-    return ss.str();
+std::string format(const char* fmt, const T&... args) {
+    std::string out;
+    format_to(out, fmt, args...);
+    return out;
+}
+
+template <unsigned N, typename... T>
+std::string format(const FormatString<N>& fmt, const T&... args) {
+    std::string out;
+    format_to(out, fmt, args...);
+    return out;
 }
 
 }  // namespace zeroerr
@@ -23,7 +23,7 @@ ZEROERR_SUPPRESS_COMMON_WARNINGS_PUSH
 #define ZEROERR_CREATE_FUZZ_TEST_FUNC(function, name, ...)                                  \
     static void                     function(zeroerr::TestContext*);                        \
     static zeroerr::detail::regTest ZEROERR_NAMEGEN(_zeroerr_reg)(                          \
-        {name, __FILE__, __LINE__, function, {__VA_ARGS__}}, zeroerr::TestType::fuzz_test); \
+        name, __FILE__, __LINE__, function, {__VA_ARGS__}, zeroerr::TestType::fuzz_test);   \
     static void function(ZEROERR_UNUSED(zeroerr::TestContext* _ZEROERR_TEST_CONTEXT))
 
 #define FUZZ_TEST_CASE(...) \
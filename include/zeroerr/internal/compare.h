@@ -0,0 +1,183 @@
+#pragma once
+#include "zeroerr/internal/config.h"
+
+#include "zeroerr/format.h"
+#include "zeroerr/internal/decomposition.h"
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <type_traits>
+
+ZEROERR_SUPPRESS_COMMON_WARNINGS_PUSH
+
+// The number of mismatches reported by CHECK_ARRAY_EQ, CHECK_ALL_CLOSE and CHECK_BYTES_EQ
+#ifndef ZEROERR_MAX_MISMATCHES
+#define ZEROERR_MAX_MISMATCHES 8
+#endif
+
+namespace zeroerr {
+
+namespace detail {
+
+// The kernels return the index of the first element in [0, n) that differs, or n if all
+// elements are the same. They use AVX2 if the CPU supports it, SSE2 on x86-64 and a scalar
+// loop on other platforms. Two values are close if a == b or |a - b| <= atol + rtol * |b|,
+// NaN is not close to anything.
+extern size_t findMismatchBytes(const void* a, const void* b, size_t n);
+extern size_t findNotClose(const float* a, const float* b, size_t n, double rtol, double atol);
+extern size_t findNotClose(const double* a, const double* b, size_t n, double rtol, double atol);
+
+// the data and the size of a contiguous range: an array or a container with data() and size()
+template <typename T, size_t N>
+const T* rangeData(const T (&a)[N]) {
+    return a;
+}
+template <typename T, size_t N>
+size_t rangeSize(const T (&)[N]) {
+    return N;
+}
+template <typename C>
+auto rangeData(const C& c) -> decltype(c.data()) {
+    return c.data();
+}
+template <typename C>
+auto rangeSize(const C& c) -> decltype(static_cast<size_t>(c.size())) {
+    return static_cast<size_t>(c.size());
+}
+
+#define ZEROERR_IS_BITWISE_EQ                                                    \
+    (std::is_same<T, U>::value &&                                                \
+     (std::is_integral<T>::value || std::is_enum<T>::value || std::is_pointer<T>::value))
+#define ZEROERR_IS_KERNEL_FLOAT \
+    (std::is_same<T, U>::value && (std::is_same<T, float>::value || std::is_same<T, double>::value))
+
+// find the first mismatch in [i, n)
+template <typename T, typename U>
+typename std::enable_if<ZEROERR_IS_BITWISE_EQ, size_t>::type findMismatch(const T* a, const U* b,
+                                                                           size_t i, size_t n) {
+    return i + findMismatchBytes(a + i, b + i, (n - i) * sizeof(T)) / sizeof(T);
+}
+
+template <typename T, typename U>
+typename std::enable_if<ZEROERR_IS_KERNEL_FLOAT, size_t>::type findMismatch(const T* a, const U* b,
+                                                                             size_t i, size_t n) {
+    return i + findNotClose(a + i, b + i, n - i, 0, 0);
+}
+
+template <typename T, typename U>
+typename std::enable_if<!ZEROERR_IS_BITWISE_EQ && !ZEROERR_IS_KERNEL_FLOAT, size_t>::type
+findMismatch(const T* a, const U* b, size_t i, size_t n) {
+    for (; i < n; ++i)
+        if (!(a[i] == b[i])) return i;
+    return n;
+}
+
+template <typename T, typename U>
+typename std::enable_if<ZEROERR_IS_KERNEL_FLOAT, size_t>::type findNotClose(
+    const T* a, const U* b, size_t i, size_t n, double rtol, double atol) {
+    return i + findNotClose(a + i, b + i, n - i, rtol, atol);
+}
+
+template <typename T, typename U>
+typename std::enable_if<!ZEROERR_IS_KERNEL_FLOAT, size_t>::type findNotClose(
+    const T* a, const U* b, size_t i, size_t n, double rtol, double atol) {
+    for (; i < n; ++i) {
+        double x = static_cast<double>(a[i]), y = static_cast<double>(b[i]);
+        if (!(x == y || std::fabs(x - y) <= atol + rtol * std::fabs(y))) return i;
+    }
+    return n;
+}
+
+#undef ZEROERR_IS_BITWISE_EQ
+#undef ZEROERR_IS_KERNEL_FLOAT
+
+// floating point values are printed with all digits, the difference can be invisible otherwise
+inline void formatElement(std::string& out, float v) {
+    char buf[32];
+    int  n = snprintf(buf, sizeof(buf), "%.9g", static_cast<double>(v));
+    out.append(buf, static_cast<size_t>(n));
+}
+inline void formatElement(std::string& out, double v) {
+    char buf[32];
+    int  n = snprintf(buf, sizeof(buf), "%.17g", v);
+    out.append(buf, static_cast<size_t>(n));
+}
+template <typename T>
+void formatElement(std::string& out, const T& v) {
+    format_to(out, "{}", v);
+}
+
+/**
+ * @brief report the mismatches of two ranges
+ * @param next returns the index of the next mismatch from an index, or n
+ * @details Only the first ZEROERR_MAX_MISMATCHES elements are printed, the elements are
+ * never printed if the ranges are the same.
+ */
+template <typename T, typename U, typename Next>
+ExprResult reportMismatches(const T* a, size_t na, const U* b, size_t nb, Next next) {
+    if (na != nb) return ExprResult(false, format(ZEROERR_FMT("size {} != {}"), na, nb));
+    size_t i = next(0);
+    if (i == na) return ExprResult(true);
+
+    std::string out;
+    size_t      count = 0;
+    for (; i < na; i = next(i + 1)) {
+        if (count < ZEROERR_MAX_MISMATCHES) {
+            out += count ? ", [" : ", first at [";
+            format_uint(out, i);
+            out += "] ";
+            formatElement(out, a[i]);
+            out += " vs ";
+            formatElement(out, b[i]);
+        }
+        count++;
+    }
+    if (count > ZEROERR_MAX_MISMATCHES) out += ", ...";
+    return ExprResult(false, format(ZEROERR_FMT("{} of {} elements differ"), count, na) + out);
+}
+
+template <typename A, typename B>
+ExprResult compareArrays(const A& a, const B& b) {
+    auto   pa = rangeData(a);
+    auto   pb = rangeData(b);
+    size_t n  = rangeSize(a);
+    return reportMismatches(pa, n, pb, rangeSize(b),
+                            [&](size_t i) { return findMismatch(pa, pb, i, n); });
+}
+
+template <typename A, typename B>
+ExprResult compareAllClose(const A& a, const B& b, double rtol, double atol) {
+    auto   pa = rangeData(a);
+    auto   pb = rangeData(b);
+    size_t n  = rangeSize(a);
+    return reportMismatches(pa, n, pb, rangeSize(b),
+                            [&](size_t i) { return findNotClose(pa, pb, i, n, rtol, atol); });
+}
+
+struct HexByte {
+    uint8_t value;
+};
+inline void formatElement(std::string& out, HexByte v) {
+    static const char digits[] = "0123456789abcdef";
+    out += "0x";
+    out += digits[v.value >> 4];
+    out += digits[v.value & 0xF];
+}
+
+// compare the bytes of two buffers, the bytes are printed in hex
+inline ExprResult compareBytes(const void* a, const void* b, size_t size) {
+    const HexByte* pa = static_cast<const HexByte*>(a);
+    const HexByte* pb = static_cast<const HexByte*>(b);
+    return reportMismatches(pa, size, pb, size, [&](size_t i) {
+        return i + findMismatchBytes(pa + i, pb + i, size - i);
+    });
+}
+
+}  // namespace detail
+
+}  // namespace zeroerr
+
+ZEROERR_SUPPRESS_COMMON_WARNINGS_POP
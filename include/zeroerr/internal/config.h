@@ -75,6 +75,10 @@
 // #define ZEROERR_NO_ASSERT
 #endif
 
+// Define ZEROERR_PRODUCTION_ASSERT to keep assertions in release builds at the cost of a
+// branch: the expression is only printed and logged when the assertion fails.
+// #define ZEROERR_PRODUCTION_ASSERT
+
 // This is used for generating a unique name based on the file name and line number
 #define ZEROERR_CAT_IMPL(s1, s2) s1##s2
 #define ZEROERR_CAT(x, s)        ZEROERR_CAT_IMPL(x, s)
@@ -173,6 +177,24 @@
 #define ZEROERR_ICC 0
 #endif  // ZEROERR_ICC
 
+// Branch prediction hints, used to keep the failure path of assertions out of the hot path
+#if ZEROERR_GCC || ZEROERR_CLANG || ZEROERR_ICC
+#define ZEROERR_LIKELY(x)   __builtin_expect(!!(x), 1)
+#define ZEROERR_UNLIKELY(x) __builtin_expect(!!(x), 0)
+#else
+#define ZEROERR_LIKELY(x)   (x)
+#define ZEROERR_UNLIKELY(x) (x)
+#endif
+
+// Keep a rarely called function out of line and away from the hot code
+#if ZEROERR_GCC || ZEROERR_CLANG || ZEROERR_ICC
+#define ZEROERR_COLD __attribute__((cold, noinline))
+#elif defined(_MSC_VER)
+#define ZEROERR_COLD __declspec(noinline)
+#else
+#define ZEROERR_COLD
+#endif
+
 
 // =================================================================================================
 // == COMPILER WARNINGS HELPERS ====================================================================
@@ -3,8 +3,11 @@
 #include "zeroerr/internal/config.h"
 
 #include "zeroerr/dbg.h"
+#include "zeroerr/internal/diff.h"
 #include "zeroerr/print.h"
 
+#include <cstring>
+
 ZEROERR_SUPPRESS_COMMON_WARNINGS_PUSH
 ZEROERR_SUPPRESS_COMPARE
 
@@ -37,42 +40,23 @@ struct deferred_false {
     template <typename R>                                                                          \
     ZEROERR_SFINAE_OP(Expression<R>, op)                                                           \
     operator op(R && rhs) {                                                                        \
-        std::stringstream ss;                                                                      \
-        Printer           print(ss);                                                               \
-        print.isCompact  = true;                                                                   \
-        print.line_break = "";                                                                     \
-        if (decomp.empty()) {                                                                      \
-            print(lhs);                                                                            \
-            res = true;                                                                            \
-        } else                                                                                     \
-            ss << decomp;                                                                          \
-        ss << " " #op " ";                                                                         \
-        print(rhs);                                                                                \
-        return Expression<R>(static_cast<R&&>(rhs), res && (lhs op rhs), ss.str());                \
+        bool r = (render_prev ? res : true) && (lhs op rhs);                                       \
+        return Expression<R>(static_cast<R&&>(rhs), r, this, &Expression::render, #op,            \
+                             render_prev ? nullptr : diff_renderer<R>());                          \
     }                                                                                              \
     template <typename R,                                                                          \
               typename std::enable_if<!std::is_rvalue_reference<R>::value, void>::type* = nullptr> \
     ZEROERR_SFINAE_OP(Expression<const R&>, op)                                                    \
     operator op(const R & rhs) {                                                                   \
-        std::stringstream ss;                                                                      \
-        Printer           print(ss);                                                               \
-        print.isCompact  = true;                                                                   \
-        print.line_break = "";                                                                     \
-        if (decomp.empty()) {                                                                      \
-            print(lhs);                                                                            \
-            res = true;                                                                            \
-        } else                                                                                     \
-            ss << decomp;                                                                          \
-        ss << " " #op " ";                                                                         \
-        print(rhs);                                                                                \
-        return Expression<const R&>(rhs, res && (lhs op rhs), ss.str());                           \
+        bool r = (render_prev ? res : true) && (lhs op rhs);                                       \
+        return Expression<const R&>(rhs, r, this, &Expression::render, #op,                        \
+                                    render_prev ? nullptr : diff_renderer<const R&>());            \
     }
 
-#define ZEROERR_EXPRESSION_ANDOR(op, op_name)        \
-    ExprResult operator op(ExprResult rhs) {         \
-        std::stringstream ss;                        \
-        ss << decomp << " " #op " " << rhs.decomp;   \
-        return ExprResult(res op rhs.res, ss.str()); \
+#define ZEROERR_EXPRESSION_ANDOR(op, op_name)                              \
+    ExprResult operator op(ExprResult rhs) {                               \
+        ExprResult self = *this;                                           \
+        return ExprResult(self.res op rhs.res, self.str() + " " #op " " + rhs.str()); \
     }
 
 
@@ -84,11 +68,36 @@ struct deferred_false {
         return *this;                                                     \
     }
 
+/**
+ * @brief ExprResult is the result of a decomposed expression.
+ * @details The operands are not printed when the expression is evaluated. The result
+ * keeps a pointer to the expression, which lives until the end of the full expression
+ * of the assertion, and str() prints it only when the assertion fails.
+ */
 struct ExprResult {
+    typedef void (*RenderFn)(const void* expr, Printer& print);
+
     bool        res;
     std::string decomp;
+    const void* expr   = nullptr;
+    RenderFn    render = nullptr;
 
     ExprResult(bool res, std::string decomposition = "") : res(res), decomp(decomposition) {}
+    ExprResult(bool res, const void* expr, RenderFn render)
+        : res(res), expr(expr), render(render) {}
+
+    // print the operands, it must be called before the end of the full expression
+    std::string str() {
+        if (render) {
+            decomp.clear();
+            Printer print(decomp);
+            print.isCompact  = true;
+            print.line_break = "";
+            render(expr, print);
+            render = nullptr;
+        }
+        return decomp;
+    }
 
     ZEROERR_EXPRESSION_ANDOR(&&, and)
     ZEROERR_EXPRESSION_ANDOR(||, or)
@@ -126,24 +135,67 @@ typename std::enable_if<!std::is_convertible<T, bool>::value, bool>::type getBoo
 }
 }  // namespace details
 
+/**
+ * @brief Expression holds an operand of a decomposed expression.
+ * @details The operand is stored by reference unless it is a temporary. A comparison
+ * returns the Expression of the right operand linked to the left one, so the whole
+ * chain can be printed from the last Expression when it is needed.
+ */
 template <typename L>
 struct Expression {
-    L           lhs;
-    bool        res = true;
-    std::string decomp;
+    L    lhs;
+    bool res = true;
 
-    explicit Expression(L&& in) : lhs(static_cast<L&&>(in)) { res = details::getBool(lhs); }
-    explicit Expression(L&& in, bool res, std::string&& decomp)
-        : lhs(static_cast<L&&>(in)), res(res), decomp(static_cast<std::string&&>(decomp)) {}
+    // the previous operand and the operator of a comparison, e.g. `a` and "<" in `a < b`
+    const void*          prev        = nullptr;
+    ExprResult::RenderFn render_prev = nullptr;
+    const char*          op          = nullptr;
 
-    operator ExprResult() {
-        if (decomp.empty()) {
-            Printer print;
-            print.isCompact  = true;
-            print.line_break = "";
-            decomp           = print(lhs).str();
+    // prints the differences of `a == b` when both operands are containers
+    ExprResult::RenderFn render_diff = nullptr;
+
+    explicit Expression(L&& in) : lhs(static_cast<L&&>(in)) { res = details::getBool(lhs); }
+    explicit Expression(L&& in, bool res, const void* prev, ExprResult::RenderFn render_prev,
+                        const char* op, ExprResult::RenderFn render_diff)
+        : lhs(static_cast<L&&>(in)),
+          res(res),
+          prev(prev),
+          render_prev(render_prev),
+          op(op),
+          render_diff(render_diff) {}
+
+    static void render(const void* p, Printer& print) {
+        const Expression* e = static_cast<const Expression*>(p);
+        if (e->render_prev) {
+            e->render_prev(e->prev, print);
+            print.os << " " << e->op << " ";
         }
-        return ExprResult(res, decomp);
+        print(e->lhs);
+    }
+
+    // E is the Expression of the right operand, this is the left one
+    template <typename E>
+    static void render_diff_with(const void* p, Printer& print) {
+        const E*          e    = static_cast<const E*>(p);
+        const Expression* prev = static_cast<const Expression*>(e->prev);
+        if (std::strcmp(e->op, "==") != 0 || !detail::printDiff(print, prev->lhs, e->lhs))
+            E::render(p, print);
+    }
+
+    template <typename R>
+    static typename std::enable_if<detail::is_diffable<L, R>::value, ExprResult::RenderFn>::type
+    diff_renderer() {
+        return &Expression::template render_diff_with<Expression<R>>;
+    }
+
+    template <typename R>
+    static typename std::enable_if<!detail::is_diffable<L, R>::value, ExprResult::RenderFn>::type
+    diff_renderer() {
+        return nullptr;
+    }
+
+    operator ExprResult() const {
+        return ExprResult(res, this, render_diff ? render_diff : &Expression::render);
     }
 
     operator L() const { return lhs; }
@@ -176,6 +228,31 @@ struct Expression {
     ZEROERR_FORBIT_EXPRESSION(Expression, >>)
 };
 
+/**
+ * @brief CompareExpression holds the operands of CHECK_EQ and the other comparison
+ * assertions, they are printed only when the assertion fails.
+ */
+template <typename L, typename R>
+struct CompareExpression {
+    const L&    lhs;
+    const char* op;
+    const R&    rhs;
+
+    static void render(const void* p, Printer& print) {
+        const CompareExpression* e = static_cast<const CompareExpression*>(p);
+        print.isQuoted             = false;
+        if (std::strcmp(e->op, "==") != 0 || !detail::printDiff(print, e->lhs, e->rhs))
+            print(e->lhs, e->op, e->rhs);
+    }
+
+    ExprResult result(bool res) const { return ExprResult(res, this, &CompareExpression::render); }
+};
+
+template <typename L, typename R>
+CompareExpression<L, R> make_compare(const L& lhs, const char* op, const R& rhs) {
+    return CompareExpression<L, R>{lhs, op, rhs};
+}
+
 #undef ZEROERR_EXPRESSION_COMPARISON
 #undef ZEROERR_EXPRESSION_ANDOR
 #undef ZEROERR_FORBIT_EXPRESSION
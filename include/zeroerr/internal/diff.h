@@ -0,0 +1,382 @@
+#pragma once
+#include "zeroerr/internal/config.h"
+
+#include "zeroerr/internal/typetraits.h"
+#include "zeroerr/print.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <ostream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+ZEROERR_SUPPRESS_COMMON_WARNINGS_PUSH
+
+// A failed equality assertion prints the differences of two containers instead of all the
+// elements if one of them has more elements than this
+#ifndef ZEROERR_DIFF_MIN_SIZE
+#define ZEROERR_DIFF_MIN_SIZE 16
+#endif
+
+// The number of unchanged elements printed around each difference
+#ifndef ZEROERR_DIFF_CONTEXT
+#define ZEROERR_DIFF_CONTEXT 2
+#endif
+
+// The maximum number of lines and the maximum width of an element in a diff
+#ifndef ZEROERR_DIFF_MAX_LINES
+#define ZEROERR_DIFF_MAX_LINES 40
+#endif
+#ifndef ZEROERR_DIFF_MAX_WIDTH
+#define ZEROERR_DIFF_MAX_WIDTH 120
+#endif
+
+// The differing parts of two sequences are aligned by the Myers algorithm if both of them
+// are not longer than this, otherwise the elements are compared index by index
+#ifndef ZEROERR_DIFF_WINDOW
+#define ZEROERR_DIFF_WINDOW 512
+#endif
+
+namespace zeroerr {
+
+namespace detail {
+
+template <typename T>
+using has_comparable_elements =
+    void_t<decltype(*std::declval<const T&>().begin() == *std::declval<const T&>().begin())>;
+
+template <typename T>
+using has_mapped_type = void_t<typename T::mapped_type>;
+
+template <typename T, typename = void>
+struct is_map_container : std::false_type {};
+
+template <typename T>
+struct is_map_container<T, has_mapped_type<T>> : is_associative_container<T> {};
+
+// two operands can be diffed if they are containers of the same type but not strings
+template <typename L, typename R, typename = void>
+struct is_diffable : std::false_type {};
+
+template <typename L, typename R>
+struct is_diffable<L, R, has_comparable_elements<typename std::decay<L>::type>>
+    : std::integral_constant<
+          bool, std::is_same<typename std::decay<L>::type, typename std::decay<R>::type>::value &&
+                    is_container<typename std::decay<L>::type>::value &&
+                    !is_string<typename std::decay<L>::type>::value &&
+                    !is_specialization<typename std::decay<L>::type, std::basic_string>::value> {};
+
+
+/**
+ * @brief DiffWriter writes the lines of a diff.
+ * @details The lines after ZEROERR_DIFF_MAX_LINES are dropped and each element is cut at
+ * ZEROERR_DIFF_MAX_WIDTH characters, so the output is bounded however large the
+ * containers are.
+ */
+struct DiffWriter {
+    DiffWriter(std::ostream& os, bool isQuoted) : os(os), isQuoted(isQuoted) {}
+
+    template <typename T>
+    void line(char mark, size_t index, const T& value) {
+        if (!next()) return;
+        os << '\n' << mark << " [" << index << "] " << element(value);
+    }
+
+    template <typename K, typename V>
+    void entry(char mark, const K& key, const V& value) {
+        if (!next()) return;
+        os << '\n' << mark << ' ' << element(key) << " : " << element(value);
+    }
+
+    template <typename K>
+    void key(char mark, const K& key) {
+        if (!next()) return;
+        os << '\n' << mark << ' ' << element(key);
+    }
+
+    void gap() {
+        if (next()) os << "\n  ...";
+    }
+
+    bool full() const { return lines >= ZEROERR_DIFF_MAX_LINES; }
+
+    void finish() {
+        if (truncated) os << "\n(the diff is truncated after " << ZEROERR_DIFF_MAX_LINES << " lines)";
+    }
+
+    template <typename T>
+    std::string element(const T& value) {
+        std::string s;
+        Printer     elem(s);
+        elem.isCompact  = true;
+        elem.isQuoted   = isQuoted;
+        elem.line_break = "";
+        elem(value);
+        if (s.size() > ZEROERR_DIFF_MAX_WIDTH) {
+            s.resize(ZEROERR_DIFF_MAX_WIDTH);
+            s += "...";
+        }
+        return s;
+    }
+
+    bool next() {
+        if (full()) {
+            truncated = true;
+            return false;
+        }
+        lines++;
+        return true;
+    }
+
+    std::ostream& os;
+    bool          isQuoted;
+    unsigned      lines     = 0;
+    bool          truncated = false;
+};
+
+
+// lhs [a0, a1) is replaced by rhs [b0, b1), one of them can be empty
+struct DiffEdit {
+    size_t a0, a1, b0, b1;
+};
+
+// indexed access to a sequence, the iterators are collected if they are not random access
+template <typename It, typename Category = typename std::iterator_traits<It>::iterator_category>
+struct DiffSeq {
+    DiffSeq(It first, It last) {
+        for (; first != last; ++first) items.push_back(first);
+    }
+    size_t size() const { return items.size(); }
+    It     at(size_t i) const { return items[i]; }
+
+    std::vector<It> items;
+};
+
+template <typename It>
+struct DiffSeq<It, std::random_access_iterator_tag> {
+    DiffSeq(It first, It last) : first(first), n(static_cast<size_t>(last - first)) {}
+    size_t size() const { return n; }
+    It     at(size_t i) const {
+        return first + static_cast<typename std::iterator_traits<It>::difference_type>(i);
+    }
+
+    It     first;
+    size_t n;
+};
+
+// merge an insertion or a deletion at (ai, bi) into the edits
+inline void addEdit(std::vector<DiffEdit>& edits, bool del, size_t ai, size_t bi) {
+    if (edits.empty() || edits.back().a1 != ai || edits.back().b1 != bi) {
+        DiffEdit e = {ai, ai, bi, bi};
+        edits.push_back(e);
+    }
+    if (del)
+        edits.back().a1++;
+    else
+        edits.back().b1++;
+}
+
+/**
+ * @brief align a[a0, a0 + n) with b[b0, b0 + m) by the Myers O(ND) algorithm
+ * @details The furthest reaching point of each diagonal is kept for every step to trace
+ * the path back, it takes O(D^2) memory which is bounded by ZEROERR_DIFF_WINDOW.
+ */
+template <typename SA, typename SB>
+void diffMyers(const SA& a, size_t a0, size_t n, const SB& b, size_t b0, size_t m,
+               std::vector<DiffEdit>& edits) {
+    const long                         max = static_cast<long>(n + m);
+    std::vector<long>                  v(static_cast<size_t>(2 * max + 3), 0);
+    std::vector<std::vector<uint32_t>> trace;  // the diagonals -d..d of each step d
+
+    const long N = static_cast<long>(n), M = static_cast<long>(m);
+    for (long d = 0; d <= max; ++d) {
+        bool done = false;
+        for (long k = -d; k <= d && !done; k += 2) {
+            long* p = &v[static_cast<size_t>(max + 1 + k)];
+            long  x = (k == -d || (k != d && p[-1] < p[1])) ? p[1] : p[-1] + 1;
+            long  y = x - k;
+            while (x < N && y < M &&
+                   *a.at(a0 + static_cast<size_t>(x)) == *b.at(b0 + static_cast<size_t>(y)))
+                x++, y++;
+            *p   = x;
+            done = x >= N && y >= M;
+        }
+        trace.emplace_back(v.begin() + (max + 1 - d), v.begin() + (max + 2 + d));
+        if (done) break;
+    }
+
+    // trace back from (n, m), the edits are found in reverse order
+    std::vector<DiffEdit> rev;
+    long                  x = N, y = M;
+    for (long d = static_cast<long>(trace.size()) - 1; d > 0; --d) {
+        const std::vector<uint32_t>& V = trace[static_cast<size_t>(d - 1)];
+        long                         k = x - y;
+        auto get = [&](long kk) { return static_cast<long>(V[static_cast<size_t>(kk + d - 1)]); };
+        bool ins = k == -d || (k != d && get(k - 1) < get(k + 1));
+        long pk  = ins ? k + 1 : k - 1;
+        long px  = get(pk), py = px - pk;
+        DiffEdit e = {static_cast<size_t>(px), static_cast<size_t>(px) + !ins,
+                      static_cast<size_t>(py), static_cast<size_t>(py) + ins};
+        rev.push_back(e);
+        x = px;
+        y = py;
+    }
+    for (size_t i = rev.size(); i > 0; --i) {
+        const DiffEdit& e = rev[i - 1];
+        addEdit(edits, e.a1 != e.a0, a0 + e.a0, b0 + e.b0);
+    }
+}
+
+// compare a[i] with b[i] in [lo, hi), return the number of different elements
+template <typename SA, typename SB>
+size_t diffAligned(const SA& a, const SB& b, size_t lo, size_t hi, std::vector<DiffEdit>& edits) {
+    size_t count = 0;
+    for (size_t i = lo; i < hi; ++i) {
+        if (*a.at(i) == *b.at(i)) continue;
+        count++;
+        if (!edits.empty() && edits.back().a1 == i) {
+            edits.back().a1++;
+            edits.back().b1++;
+        } else if (edits.size() < ZEROERR_DIFF_MAX_LINES) {
+            DiffEdit e = {i, i + 1, i, i + 1};
+            edits.push_back(e);
+        }
+    }
+    return count;
+}
+
+// print the edits with ZEROERR_DIFF_CONTEXT elements of context, the indices are of lhs
+// except for the inserted elements
+template <typename SA, typename SB>
+void printEdits(DiffWriter& w, const SA& a, const SB& b, const std::vector<DiffEdit>& edits) {
+    size_t shown = 0, n = a.size();
+    for (size_t e = 0; e < edits.size() && !w.full(); ++e) {
+        const DiffEdit& d    = edits[e];
+        size_t          from = d.a0 > ZEROERR_DIFF_CONTEXT ? d.a0 - ZEROERR_DIFF_CONTEXT : 0;
+        if (from < shown) from = shown;
+        if (from > shown) w.gap();
+        for (size_t i = from; i < d.a0; ++i) w.line(' ', i, *a.at(i));
+        for (size_t i = d.a0; i < d.a1; ++i) w.line('-', i, *a.at(i));
+        for (size_t j = d.b0; j < d.b1; ++j) w.line('+', j, *b.at(j));
+
+        size_t to = d.a1 + ZEROERR_DIFF_CONTEXT < n ? d.a1 + ZEROERR_DIFF_CONTEXT : n;
+        if (e + 1 < edits.size() && edits[e + 1].a0 < to) to = edits[e + 1].a0;
+        for (size_t i = d.a1; i < to; ++i) w.line(' ', i, *a.at(i));
+        shown = to;
+    }
+    if (shown < n) w.gap();
+}
+
+template <typename L, typename R>
+bool diffSequence(DiffWriter& w, const L& lhs, const R& rhs) {
+    DiffSeq<decltype(lhs.begin())> a(lhs.begin(), lhs.end());
+    DiffSeq<decltype(rhs.begin())> b(rhs.begin(), rhs.end());
+    size_t n = a.size(), m = b.size();
+    if (n <= ZEROERR_DIFF_MIN_SIZE && m <= ZEROERR_DIFF_MIN_SIZE) return false;
+
+    // the common prefix and suffix are skipped
+    size_t lo = 0, ea = n, eb = m;
+    while (lo < n && lo < m && *a.at(lo) == *b.at(lo)) lo++;
+    while (ea > lo && eb > lo && *a.at(ea - 1) == *b.at(eb - 1)) ea--, eb--;
+
+    std::vector<DiffEdit> edits;
+    if (ea - lo <= ZEROERR_DIFF_WINDOW && eb - lo <= ZEROERR_DIFF_WINDOW) {
+        diffMyers(a, lo, ea - lo, b, lo, eb - lo, edits);
+        w.os << "size " << n << " vs " << m;
+    } else if (n == m) {
+        size_t count = diffAligned(a, b, lo, ea, edits);
+        w.os << count << " of " << n << " elements differ";
+    } else {
+        // align the beginning of the differing parts only, the edits reaching the end of
+        // the window are dropped as they may be cut by it
+        diffMyers(a, lo, ea - lo < ZEROERR_DIFF_WINDOW ? ea - lo : ZEROERR_DIFF_WINDOW, b, lo,
+                  eb - lo < ZEROERR_DIFF_WINDOW ? eb - lo : ZEROERR_DIFF_WINDOW, edits);
+        while (edits.size() > 1 && (edits.back().a1 >= lo + ZEROERR_DIFF_WINDOW ||
+                                    edits.back().b1 >= lo + ZEROERR_DIFF_WINDOW))
+            edits.pop_back();
+        w.os << "size " << n << " vs " << m << ", the first difference at [" << lo << "]";
+    }
+    printEdits(w, a, b, edits);
+    return true;
+}
+
+// the keys only in lhs, the keys only in rhs, and for maps the keys with different values
+template <typename L, typename R>
+bool diffAssociative(DiffWriter& w, const L& a, const R& b, std::true_type /*map*/) {
+    if (a.size() <= ZEROERR_DIFF_MIN_SIZE && b.size() <= ZEROERR_DIFF_MIN_SIZE) return false;
+    w.os << "size " << a.size() << " vs " << b.size();
+    for (auto& v : a) {
+        auto it = b.find(v.first);
+        if (it == b.end()) {
+            w.entry('-', v.first, v.second);
+        } else if (!(v.second == it->second)) {
+            w.entry('-', v.first, v.second);
+            w.entry('+', it->first, it->second);
+        }
+        if (w.full()) break;
+    }
+    for (auto& v : b) {
+        if (a.find(v.first) == a.end()) w.entry('+', v.first, v.second);
+        if (w.full()) break;
+    }
+    return true;
+}
+
+template <typename L, typename R>
+bool diffAssociative(DiffWriter& w, const L& a, const R& b, std::false_type /*set*/) {
+    if (a.size() <= ZEROERR_DIFF_MIN_SIZE && b.size() <= ZEROERR_DIFF_MIN_SIZE) return false;
+    w.os << "size " << a.size() << " vs " << b.size();
+    for (auto& v : a) {
+        if (b.find(v) == b.end()) w.key('-', v);
+        if (w.full()) break;
+    }
+    for (auto& v : b) {
+        if (a.find(v) == a.end()) w.key('+', v);
+        if (w.full()) break;
+    }
+    return true;
+}
+
+template <typename L, typename R>
+bool diffContainers(DiffWriter& w, const L& a, const R& b, std::true_type /*associative*/) {
+    return diffAssociative(w, a, b, is_map_container<L>{});
+}
+
+template <typename L, typename R>
+bool diffContainers(DiffWriter& w, const L& a, const R& b, std::false_type /*associative*/) {
+    return diffSequence(w, a, b);
+}
+
+/**
+ * @brief print the differences of two large containers
+ * @return false if the containers are small or cannot be diffed, they should be printed
+ * as they are.
+ *
+ * Sequences are printed as a unified diff with the indices of the elements, associative
+ * containers are printed as the keys missing from either side and the keys whose values
+ * differ. The output is at most ZEROERR_DIFF_MAX_LINES lines, even for containers with
+ * millions of elements.
+ */
+template <typename L, typename R>
+typename std::enable_if<is_diffable<L, R>::value, bool>::type printDiff(Printer&  print,
+                                                                        const L& a,
+                                                                        const R& b) {
+    DiffWriter w(print.os, print.isQuoted);
+    if (!diffContainers(w, a, b, is_associative_container<L>{})) return false;
+    w.finish();
+    return true;
+}
+
+template <typename L, typename R>
+typename std::enable_if<!is_diffable<L, R>::value, bool>::type printDiff(Printer&, const L&,
+                                                                         const R&) {
+    return false;
+}
+
+}  // namespace detail
+
+}  // namespace zeroerr
+
+ZEROERR_SUPPRESS_COMMON_WARNINGS_POP
@@ -11,7 +11,9 @@
 #include <chrono>
 #include <iosfwd>
 #include <map>
+#include <memory>
 #include <string>
+#include <typeinfo>
 #include <vector>
 
 ZEROERR_SUPPRESS_COMMON_WARNINGS_PUSH
@@ -63,6 +65,8 @@ namespace zeroerr {
 
 #define LOG_GET(func, id, name, type) ZEROERR_LOG_GET(func, id, name, type)
 
+#define TRACE_SCOPE(...) ZEROERR_TRACE_SCOPE(__VA_ARGS__)
+
 #endif  // ZEROERR_USE_SHORT_LOG_MACRO
 
 #define ZEROERR_LOG_IF(condition, ACTION, ...) \
@@ -171,6 +175,33 @@ extern int _ZEROERR_G_VERBOSE;
             msg.stream.flush();                                                        \
     } while (0)
 
+// clang-format off
+#define ZEROERR_TRACE_SCOPE(...) ZEROERR_SUPPRESS_VARIADIC_MACRO ZEROERR_EXPAND(ZEROERR_TRACE_SCOPE_(ZEROERR_NAMEGEN(_trace_), __VA_ARGS__)) ZEROERR_SUPPRESS_VARIADIC_MACRO_POP
+// clang-format on
+
+// A trace scope pushes two records into the stream: the begin record carries the
+// arguments, the end record is pushed by the destructor of TraceScope.
+#define ZEROERR_TRACE_SCOPE_(v_name, message, ...)                                             \
+    auto                    v_name = zeroerr::log(__VA_ARGS__);                                \
+    static zeroerr::LogInfo ZEROERR_CAT(v_name, _begin){__FILE__,                              \
+                                                        __func__,                              \
+                                                        message,                               \
+                                                        ZEROERR_LOG_CATEGORY,                  \
+                                                        __LINE__,                              \
+                                                        v_name.size,                           \
+                                                        zeroerr::LogSeverity::LOG_l,           \
+                                                        zeroerr::LogEvent::SCOPE_BEGIN_e};     \
+    static zeroerr::LogInfo ZEROERR_CAT(v_name, _end){__FILE__,                                \
+                                                      __func__,                                \
+                                                      message,                                 \
+                                                      ZEROERR_LOG_CATEGORY,                    \
+                                                      __LINE__,                                \
+                                                      sizeof(zeroerr::LogMessageImpl<>),       \
+                                                      zeroerr::LogSeverity::LOG_l,             \
+                                                      zeroerr::LogEvent::SCOPE_END_e};         \
+    v_name.log->info = &ZEROERR_CAT(v_name, _begin);                                           \
+    zeroerr::TraceScope ZEROERR_CAT(v_name, _scope)(v_name, &ZEROERR_CAT(v_name, _end))
+
 #define ZEROERR_INFO_(...) \
     ZEROERR_INFO_IMPL(ZEROERR_NAMEGEN(_capture_), ZEROERR_NAMEGEN(_capture_), __VA_ARGS__)
 
@@ -217,6 +248,11 @@ std::string gen_str(const char* msg, const T&, seq<>) {
     return msg;
 }
 
+template <typename T, unsigned... I>
+void gen_str(std::string& out, const char* msg, const T& args, seq<I...>) {
+    zeroerr::format_to(out, msg, std::get<I>(args)...);
+}
+
 }  // namespace detail
 
 
@@ -228,6 +264,22 @@ enum LogSeverity {
     FATAL_l,  // it will contain a stack trace
 };
 
+/**
+ * @brief LogEvent tells whether a log record is a single event or one end of a trace span.
+ * Records pushed by LOG macros are INSTANT_e, TRACE_SCOPE pushes a SCOPE_BEGIN_e record
+ * when the scope is entered and a SCOPE_END_e record when it exits.
+ * The METRIC_*_e records are pushed by writeMetrics() in a metric snapshot.
+ */
+enum LogEvent {
+    INSTANT_e,
+    SCOPE_BEGIN_e,
+    SCOPE_END_e,
+    METRIC_COUNTER_e,
+    METRIC_GAUGE_e,
+    METRIC_HISTOGRAM_e,
+    METRIC_BUCKET_e,
+};
+
 /**
  * @brief LogInfo is a struct to store the meta data of the log message.
  * @details LogInfo is a struct to store the meta data of the log message.
@@ -255,20 +307,35 @@ enum LogSeverity {
  */
 struct LogInfo {
     const char*                filename;
+    const char*                short_filename;  // filename without the directory
     const char*                function;
     const char*                message;
     const char*                category;
     unsigned                   line;
     unsigned                   size;
     LogSeverity                severity;
+    LogEvent                   event;
     std::map<std::string, int> names;
 
     LogInfo(const char* filename, const char* function, const char* message, const char* category,
-            unsigned line, unsigned size, LogSeverity severity);
+            unsigned line, unsigned size, LogSeverity severity, LogEvent event = INSTANT_e);
 };
 
+namespace detail {
+/**
+ * @brief current_thread_id returns a small sequential id of the calling thread.
+ * It is cheaper to record than std::thread::id and readable in trace viewers.
+ */
+inline unsigned current_thread_id() {
+    static ZEROERR_ATOMIC(unsigned) next_id(0);
+    static thread_local unsigned id = ++next_id;
+    return id;
+}
+}  // namespace detail
+
 struct LogMessage;
 typedef std::string (*LogCustomCallback)(const LogMessage&, bool colorful);
+typedef void (*LogBufferCallback)(const LogMessage&, bool colorful, std::string& out);
 
 /**
  * @brief set the log level
@@ -282,9 +349,17 @@ extern void setLogCategory(const char* categories);
 
 /**
  * @brief set the log custom callback, this can support custom format of the log message
+ * @details Passing nullptr restores the default format.
  */
 extern void setLogCustomCallback(LogCustomCallback callback);
 
+/**
+ * @brief set the log custom callback which appends the log message to a buffer
+ * @details The buffer is cleared and reused by the thread for every message, so a
+ * callback writing into it does not allocate a string for each message.
+ */
+extern void setLogCustomCallback(LogBufferCallback callback);
+
 /**
  * @brief suspend the log to flush to the file
  */
@@ -295,6 +370,126 @@ extern void suspendLog();
  */
 extern void resumeLog();
 
+/**
+ * @brief FieldType is the type tag of a log field passed to a FieldVisitor.
+ */
+enum FieldType { INT_f, UINT_f, FLOAT_f, BOOL_f, STRING_f, OTHER_f };
+
+/**
+ * @brief LogField is a field of a log message passed to a FieldVisitor.
+ * @details The value points to an int64_t for INT_f, a uint64_t for UINT_f, a double
+ * for FLOAT_f, a bool for BOOL_f, `size` chars for STRING_f and to the stored field
+ * itself for OTHER_f. It is only valid during the visit. append() writes the value in
+ * the same format as getData(), only OTHER_f fields are formatted by a Printer.
+ */
+struct LogField {
+    FieldType   type;
+    const void* value;
+    size_t      size;
+    void (*print)(const LogField& field, std::string& out);
+
+    void        append(std::string& out) const { print(*this, out); }
+    std::string str() const {
+        std::string out;
+        print(*this, out);
+        return out;
+    }
+};
+
+/**
+ * @brief FieldVisitor receives the fields of a log message by LogMessage::visit().
+ * @details Fields are visited in the order of their names, without converting them to
+ * strings or allocating memory.
+ *
+ * For example:
+ *   struct SumVisitor : FieldVisitor {
+ *       int64_t sum = 0;
+ *       void visit(const std::string&, const LogField& field) override {
+ *           if (field.type == INT_f) sum += *static_cast<const int64_t*>(field.value);
+ *       }
+ *   };
+ */
+class FieldVisitor {
+public:
+    virtual ~FieldVisitor() = default;
+    virtual void visit(const std::string& name, const LogField& field) = 0;
+};
+
+namespace detail {
+extern void print_int_field(const LogField& field, std::string& out);
+extern void print_uint_field(const LogField& field, std::string& out);
+extern void print_float_field(const LogField& field, std::string& out);
+extern void print_bool_field(const LogField& field, std::string& out);
+extern void print_string_field(const LogField& field, std::string& out);
+
+template <typename T>
+void print_other_field(const LogField& field, std::string& out) {
+    Printer print(out);
+    print.isCompact  = true;
+    print.line_break = "";
+    print(*static_cast<const T*>(field.value));
+}
+
+#define ZEROERR_IS_FAST_INT                                                                 \
+    (std::is_integral<T>::value && sizeof(T) > 1 && !std::is_same<T, bool>::value &&        \
+     !std::is_same<T, wchar_t>::value && !std::is_same<T, char16_t>::value &&               \
+     !std::is_same<T, char32_t>::value)
+#define ZEROERR_IS_FAST_FLOAT (std::is_same<T, float>::value || std::is_same<T, double>::value)
+#define ZEROERR_IS_CHAR_ARRAY \
+    (std::is_array<T>::value && \
+     std::is_same<typename std::remove_cv<typename std::remove_extent<T>::type>::type, char>::value)
+#define ZEROERR_IS_FAST_FIELD                                                        \
+    (ZEROERR_IS_FAST_INT || ZEROERR_IS_FAST_FLOAT || std::is_same<T, bool>::value || \
+     std::is_same<T, std::string>::value || ZEROERR_IS_CHAR_ARRAY)
+
+// pass a stored field to the visitor with the type tag of it
+struct FieldVisitHelper {
+    const std::string& name;
+    FieldVisitor&      visitor;
+
+    ZEROERR_ENABLE_IF(ZEROERR_IS_FAST_INT && std::is_signed<T>::value)
+    operator()(const T& v) {
+        int64_t value = v;
+        visitor.visit(name, LogField{INT_f, &value, 0, print_int_field});
+    }
+
+    ZEROERR_ENABLE_IF(ZEROERR_IS_FAST_INT && std::is_unsigned<T>::value)
+    operator()(const T& v) {
+        uint64_t value = v;
+        visitor.visit(name, LogField{UINT_f, &value, 0, print_uint_field});
+    }
+
+    ZEROERR_ENABLE_IF(ZEROERR_IS_FAST_FLOAT)
+    operator()(const T& v) {
+        double value = v;
+        visitor.visit(name, LogField{FLOAT_f, &value, 0, print_float_field});
+    }
+
+    ZEROERR_ENABLE_IF((std::is_same<T, bool>::value))
+    operator()(const T& v) { visitor.visit(name, LogField{BOOL_f, &v, 0, print_bool_field}); }
+
+    ZEROERR_ENABLE_IF((std::is_same<T, std::string>::value))
+    operator()(const T& v) {
+        visitor.visit(name, LogField{STRING_f, v.data(), v.size(), print_string_field});
+    }
+
+    // string literals are stored as a reference to the array
+    ZEROERR_ENABLE_IF(ZEROERR_IS_CHAR_ARRAY)
+    operator()(const T& v) {
+        size_t size = std::char_traits<char>::length(v);
+        visitor.visit(name, LogField{STRING_f, v, size, print_string_field});
+    }
+
+    ZEROERR_ENABLE_IF(!ZEROERR_IS_FAST_FIELD)
+    operator()(const T& v) { visitor.visit(name, LogField{OTHER_f, &v, 0, print_other_field<T>}); }
+};
+
+#undef ZEROERR_IS_FAST_INT
+#undef ZEROERR_IS_FAST_FLOAT
+#undef ZEROERR_IS_CHAR_ARRAY
+#undef ZEROERR_IS_FAST_FIELD
+}  // namespace detail
+
 /**
  * @brief LogMessage is a class to store the log message.
  * @details LogMessage is a class to store the log message and a base class
@@ -304,25 +499,37 @@ extern void resumeLog();
  * You can also get the raw pointer of the arguments with the getRawLog() function.
  */
 struct LogMessage {
-    // time is assigned when the log message is created
-    LogMessage() { time = std::chrono::system_clock::now(); }
+    // time and thread are assigned when the log message is created
+    LogMessage() {
+        time   = std::chrono::system_clock::now();
+        thread = detail::current_thread_id();
+    }
 
     // convert the log message to a string
     virtual std::string str() const = 0;
 
+    // append the log message to the buffer
+    virtual void str(std::string& out) const = 0;
+
     // get the raw data pointer of the field with the name
     virtual void* getRawLog(std::string name) const = 0;
 
+    // visit all the fields with their names, type tags and raw values
+    virtual void visit(FieldVisitor& visitor) const = 0;
+
     // a map of the data indexing by the field name
     // for example: log("print {i}", 1);
     // a map of {"i": "1"} will be returned
-    virtual std::map<std::string, std::string> getData() const = 0;
+    std::map<std::string, std::string> getData() const;
 
     // meta data of this log message
     const LogInfo* info;
 
     // recorded wall time
     std::chrono::system_clock::time_point time;
+
+    // the thread which created this log message
+    unsigned thread;
 };
 
 
@@ -330,7 +537,7 @@ struct LogMessage {
  * @brief LogMessageImpl is the implementation of the LogMessage.
  * @details LogMessageImpl is the implementation of the LogMessage. It stores
  * the arguments in a tuple and provides the str() function to convert the log
- * message to a string. All fields could be accessed by getRawLog() or getData().
+ * message to a string. All fields could be accessed by getRawLog(), visit() or getData().
  */
 template <typename... T>
 struct LogMessageImpl final : LogMessage {
@@ -341,6 +548,10 @@ struct LogMessageImpl final : LogMessage {
         return gen_str(info->message, args, detail::gen_seq<sizeof...(T)>{});
     }
 
+    void str(std::string& out) const override {
+        gen_str(out, info->message, args, detail::gen_seq<sizeof...(T)>{});
+    }
+
     // This is a helper class to get the raw pointer of the tuple
     struct GetTuplePtr {
         void* ptr = nullptr;
@@ -356,29 +567,9 @@ struct LogMessageImpl final : LogMessage {
         return f.ptr;
     }
 
-    struct PrintTupleData {
-        std::map<std::string, std::string> data;
-        Printer                            print;
-        std::string                        name;
-
-        PrintTupleData() : print() {
-            print.isCompact  = true;
-            print.line_break = "";
-        }
-
-        template <typename H>
-        void operator()(H& v) {
-            data[name] = print(v);
-        }
-    };
-
-    std::map<std::string, std::string> getData() const override {
-        PrintTupleData printer;
-        for (auto it = info->names.begin(); it != info->names.end(); ++it) {
-            printer.name = it->first;
-            detail::visit_at(args, it->second, printer);
-        }
-        return printer.data;
+    void visit(FieldVisitor& visitor) const override {
+        for (auto it = info->names.begin(); it != info->names.end(); ++it)
+            detail::visit_at(args, it->second, detail::FieldVisitHelper{it->first, visitor});
     }
 };
 
@@ -455,6 +646,7 @@ public:
 protected:
     bool check_filter();
     void next();
+    void skip_empty();
 
     DataBlock*  p;
     LogMessage* q;
@@ -571,6 +763,45 @@ public:
     void setStdoutLogger();
     void setStderrLogger();
 
+    /**
+     * @brief write the messages as Chrome Trace Event JSON
+     * @param name The output file, which can be opened by chrome://tracing or Perfetto
+     *
+     * TRACE_SCOPE records become duration events ("B"/"E") and other log
+     * messages become instant events. Nothing is formatted until the stream flushes.
+     */
+    void setTraceLogger(std::string name);
+
+    /**
+     * @brief write the metric snapshots in the text exposition format
+     * @param name The output file, which is replaced by each snapshot
+     *
+     * Each snapshot pushed by writeMetrics() is written to a temporary file
+     * first and renamed when complete, so a scraper never reads a partial file.
+     */
+    void setMetricsLogger(std::string name);
+
+    /**
+     * @brief write the messages in the binary log format, which can be read by LogFileReader
+     * @param name The log file, the index is written to "<name>.idx"
+     * @param index_interval The number of flushed blocks covered by an index entry
+     */
+    void setBinaryLogger(std::string name, unsigned index_interval = 16);
+
+    /**
+     * @brief write the messages into a shared memory ring, which can be read by LogRingReader
+     * @param name The name of the shared memory object, removed when the logger is replaced
+     * @param size The size of the ring in bytes
+     *
+     * Messages are dropped and counted when the ring is full, the producer never waits
+     * for the consumer. Only POSIX shared memory is supported.
+     */
+    void setSharedMemoryLogger(std::string name, size_t size = 1 << 22);
+
+    /**
+     * @brief get the default stream, or the private stream of the innermost
+     * LogCaptureScope in the current thread
+     */
     static LogStream& getDefault();
 
     void setFlushAtOnce() { flush_mode = FLUSH_AT_ONCE; }
@@ -620,6 +851,120 @@ PushResult log(LogStream& stream, T&&... args) {
 }
 
 
+/**
+ * @brief TraceScope pushes the end record of a TRACE_SCOPE span when it is destroyed.
+ * @details The begin record is pushed by the macro so that its arguments are stored
+ * the same way as a LOG message. Both records are only timestamped pushes,
+ * formatting happens when the stream is flushed.
+ *
+ * Example:
+ *    void load(std::string file) {
+ *        TRACE_SCOPE("load {file}", file);
+ *        ...
+ *    }
+ */
+class TraceScope {
+public:
+    TraceScope(const PushResult& begin, const LogInfo* end_info)
+        : stream(begin.stream), end_info(end_info) {
+        if (stream.getFlushMode() == LogStream::FlushMode::FLUSH_AT_ONCE) stream.flush();
+    }
+    ~TraceScope() {
+        PushResult msg = stream.push();
+        msg.log->info  = end_info;
+        if (stream.getFlushMode() == LogStream::FlushMode::FLUSH_AT_ONCE) stream.flush();
+    }
+
+    TraceScope(const TraceScope&)            = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+protected:
+    LogStream&     stream;
+    const LogInfo* end_info;
+};
+
+
+/**
+ * @brief LogCaptureScope redirects the logs of the current thread into a private stream.
+ * @details While the scope is alive, LogStream::getDefault() returns the private stream
+ * in the thread which created the scope, so LOG and LOG_GET only see the messages of
+ * this scope. Scopes can be nested, other threads are not affected. The private stream
+ * is flushed manually and its messages are written to stderr when the scope ends,
+ * unless another logger is set on it. A scope can also capture into a stream of the
+ * caller, which keeps the messages after the scope ends.
+ *
+ * For example:
+ *   {
+ *       LogCaptureScope capture;
+ *       run_test();
+ *       for (auto p = capture.stream().begin(); p != capture.stream().end(); ++p) ...
+ *   }
+ */
+class LogCaptureScope {
+public:
+    LogCaptureScope();
+    explicit LogCaptureScope(LogStream& stream);
+    ~LogCaptureScope();
+
+    LogCaptureScope(const LogCaptureScope&)            = delete;
+    LogCaptureScope& operator=(const LogCaptureScope&) = delete;
+
+    LogStream& stream() { return *m_stream; }
+
+protected:
+    std::unique_ptr<LogStream> owned;  // the private stream, unless the caller gives one
+    LogStream*                 m_stream;
+    LogStream*                 previous;
+};
+
+
+namespace detail {
+/**
+ * @brief create the LogInfo of a deferred dbg() call site, it is called once for each site
+ * @details The message is the expressions, a placeholder named by each expression and the
+ * types of them, e.g. "x, y = {x} {y} (int, double)". Braces in the expressions and the
+ * types are replaced by parentheses so they are not taken as placeholders.
+ */
+extern const LogInfo& makeDebugInfo(const char* file, unsigned line, const char* func,
+                                    const char* exprs, const char* category,
+                                    const std::type_info* const* types, unsigned n,
+                                    unsigned size);
+}  // namespace detail
+
+/**
+ * @brief DebugLog is the deferred version of DebugExpr used by ZEROERR_DBG_LOG.
+ * @details The values are pushed to the default LogStream as a record of the call site
+ * and the last value is returned. Nothing is printed and no lock is taken if the stream
+ * is lock free, the record is rendered with the expressions and the types when the
+ * stream is flushed.
+ */
+template <typename Site, typename... T>
+auto DebugLog(Site site, const char* func, T... t) -> typename last<T...>::type {
+    PushResult            msg     = LogStream::getDefault().push(t...);
+    const std::type_info* types[] = {&typeid(T)...};
+    msg.log->info                 = &site(func, types, sizeof...(T), msg.size);
+    return get_last(t...);
+}
+
+// The lambda is the call site, its LogInfo is created by the first call
+#define ZEROERR_DBG_LOG(...)                                                                  \
+    zeroerr::DebugLog(                                                                        \
+        [](const char* _zeroerr_func, const std::type_info* const* _zeroerr_types, unsigned n, \
+           unsigned size) -> const zeroerr::LogInfo& {                                        \
+            static const zeroerr::LogInfo& info = zeroerr::detail::makeDebugInfo(            \
+                __FILE__, __LINE__, _zeroerr_func, #__VA_ARGS__, ZEROERR_LOG_CATEGORY,        \
+                _zeroerr_types, n, size);                                                     \
+            return info;                                                                      \
+        },                                                                                    \
+        __func__, __VA_ARGS__)
+
+// dbg() pushes a log record instead of printing to stderr
+#if defined(ZEROERR_DEFERRED_DBG) && defined(dbg)
+#undef dbg
+#define dbg(...) ZEROERR_DBG_LOG(__VA_ARGS__)
+#endif
+
+
 /**
  * @brief ContextScope is a helper class created in each basic block where you use INFO().
  * The context scope can has lazy evaluated function F(std::ostream&) that is called when the
@@ -0,0 +1,351 @@
+#pragma once
+#include "zeroerr/internal/config.h"
+
+#include "zeroerr/log.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+ZEROERR_SUPPRESS_COMMON_WARNINGS_PUSH
+
+namespace zeroerr {
+
+namespace detail {
+
+/**
+ * The binary log written by LogStream::setBinaryLogger consists of two files.
+ *
+ * The log file starts with the 8 bytes magic "ZEROERRB" and a 8 bytes version, followed
+ * by records. Each record is a BinaryLogRecord header and `fields` values, each value is a
+ * uint32_t length and the printed bytes of the field. Records are padded to 8 bytes.
+ *
+ * The index file "<name>.idx" starts with the magic "ZEROERRI" and contains tagged entries:
+ *  - BinaryLogSite: the meta data of a log site, written before the first record of the
+ *    site can be read. It is followed by the strings filename, function, message,
+ *    category and the field names, each is a uint32_t length and the bytes.
+ *  - BinaryLogBlock: the offset range and time range of the records of every N blocks.
+ *
+ * Index entries are written after the records they refer to are flushed, so a
+ * file cut by a crash can still be read. Both files use the native byte order.
+ */
+constexpr uint64_t BinaryLogVersion = 1;
+
+struct BinaryLogRecord {
+    uint32_t size;    // size of the record in bytes, including the header and padding
+    uint32_t site;    // the index of the site in the index file
+    int64_t  time;    // nanoseconds since epoch
+    uint32_t thread;  // the thread which created the log message
+    uint32_t fields;  // the number of field values following the header
+};
+
+enum BinaryLogIndexTag : uint32_t { BINARY_LOG_SITE = 1, BINARY_LOG_BLOCK = 2 };
+
+struct BinaryLogSite {
+    uint32_t site;
+    uint32_t line;
+    uint32_t severity;
+    uint32_t event;
+    uint64_t offset;  // offset of the first record of this site
+    uint32_t fields;
+};
+
+struct BinaryLogBlock {
+    uint64_t begin;  // offset of the first record
+    uint64_t end;    // offset after the last record
+    int64_t  min_time;
+    int64_t  max_time;
+};
+
+/**
+ * The shared memory log ring written by LogStream::setSharedMemoryLogger is a
+ * LogRingHeader, followed by `site_size` bytes of BinaryLogSite entries (the same as in
+ * the index file) and `ring_size` bytes of records.
+ *
+ * Each record is a BinaryLogRecord header followed by `fields` typed values, a value is
+ * a uint8_t FieldType, a uint32_t length and the raw bytes: 8 bytes for INT_f, UINT_f
+ * and FLOAT_f, 1 byte for BOOL_f, the chars for STRING_f and the printed value for
+ * OTHER_f. Formatting is left to the consumer.
+ *
+ * There is one producer and one consumer. The producer drops the messages when the
+ * ring is full and never overwrites unread records. A record never wraps around, the
+ * space left at the end of the ring is skipped by a record with site LogRingPadding.
+ */
+constexpr uint64_t LogRingVersion = 1;
+constexpr uint32_t LogRingPadding = 0xFFFFFFFF;
+
+struct LogRingHeader {
+    char                  magic[8];  // "ZEROERRS"
+    uint64_t              version;
+    uint64_t              pid;
+    uint64_t              site_size;
+    uint64_t              ring_size;
+    std::atomic<uint64_t> site_used;  // bytes of site entries published
+    std::atomic<uint64_t> head;       // bytes of records published
+    std::atomic<uint64_t> tail;       // bytes of records consumed
+    std::atomic<uint64_t> dropped;    // messages dropped because the ring was full
+};
+
+}  // namespace detail
+
+
+/**
+ * @brief LogFileString is a reference to the bytes of a string in a mapped log file.
+ */
+struct LogFileString {
+    const char* data = nullptr;
+    size_t      size = 0;
+
+    std::string str() const { return std::string(data, size); }
+    bool        empty() const { return size == 0; }
+    bool        operator==(const std::string& rhs) const {
+        return rhs.size() == size && rhs.compare(0, size, data, size) == 0;
+    }
+    bool operator!=(const std::string& rhs) const { return !(*this == rhs); }
+};
+
+class LogFileReader;
+
+/**
+ * @brief LogFileRecord is a view of a record in a mapped binary log file.
+ * @details No data is copied, the record reads the fields directly from the mapping
+ * and is valid as long as the LogFileReader is alive.
+ */
+class LogFileRecord {
+public:
+    struct Site {
+        std::string              filename;
+        std::string              function;
+        std::string              message;
+        std::string              category;
+        unsigned                 line;
+        LogSeverity              severity;
+        LogEvent                 event;
+        std::vector<std::string> names;  // field names in the order they are stored
+        uint64_t                 offset;
+    };
+
+    std::chrono::system_clock::time_point time() const;
+    unsigned                              thread() const { return header()->thread; }
+    const Site&                           site() const;
+
+    unsigned      fields() const { return header()->fields; }
+    LogFileString field(unsigned index) const;
+
+    // get the field with the name, an empty string is returned if not found
+    LogFileString get(const std::string& name) const;
+
+    // the message with all fields filled in
+    std::string str() const;
+
+    friend class LogFileIterator;
+    friend class LogFileReader;
+
+protected:
+    const detail::BinaryLogRecord* header() const {
+        return reinterpret_cast<const detail::BinaryLogRecord*>(p);
+    }
+
+    const LogFileReader* reader = nullptr;
+    const char*          p      = nullptr;
+};
+
+/**
+ * @brief LogFileIterator iterates the records of a binary log file.
+ * @details It works like LogIterator, but over the bytes mapped from a file. The
+ * iterator is created by LogFileReader::begin with a site filter or a time range,
+ * and starts at the offset found from the index instead of the start of the file.
+ */
+class LogFileIterator {
+public:
+    LogFileIterator() = default;
+
+    LogFileIterator& operator++();
+    LogFileIterator  operator++(int) {
+        LogFileIterator tmp = *this;
+        ++*this;
+        return tmp;
+    }
+
+    bool operator==(const LogFileIterator& rhs) const { return record.p == rhs.record.p; }
+    bool operator!=(const LogFileIterator& rhs) const { return !(*this == rhs); }
+
+    const LogFileRecord& operator*() const { return record; }
+    const LogFileRecord* operator->() const { return &record; }
+
+    friend class LogFileReader;
+
+protected:
+    bool check_filter() const;
+    void check_end();
+    void next();
+
+    LogFileRecord     record;
+    const char*       stop = nullptr;
+    std::vector<bool> sites;  // the sites to visit, empty for all sites
+    int64_t           min_time = INT64_MIN;
+    int64_t           max_time = INT64_MAX;
+};
+
+/**
+ * @brief LogFileReader maps a binary log file written by LogStream::setBinaryLogger.
+ * @details The index file is loaded when the reader is created, so a time range or a
+ * log site can be found by a binary search without scanning the log file.
+ *
+ * For example:
+ *   LogFileReader reader("app.log");
+ *   auto from = std::chrono::system_clock::now() - std::chrono::minutes(5);
+ *   for (auto p = reader.begin(from, from + std::chrono::minutes(1)); p != reader.end(); ++p)
+ *       std::cout << p->str() << std::endl;
+ *
+ *   for (auto p = reader.begin("request {id} done"); p != reader.end(); ++p)
+ *       std::cout << p->get("id").str() << std::endl;
+ */
+class LogFileReader {
+public:
+    LogFileReader(std::string name);
+    ~LogFileReader();
+
+    LogFileReader(const LogFileReader&)            = delete;
+    LogFileReader& operator=(const LogFileReader&) = delete;
+
+    /**
+     * @brief iterate the records of the matched sites, the filters are the same as LogIterator
+     */
+    LogFileIterator begin(std::string message = "", std::string function_name = "",
+                          int line = -1) const;
+
+    /**
+     * @brief iterate the records created in the time range [from, to)
+     */
+    LogFileIterator begin(std::chrono::system_clock::time_point from,
+                          std::chrono::system_clock::time_point to) const;
+
+    LogFileIterator end() const { return LogFileIterator(); }
+
+    const std::vector<LogFileRecord::Site>& sites() const { return m_sites; }
+
+    friend class LogFileRecord;
+
+protected:
+    void close();
+    void load_index(const std::string& name);
+    void scan_tail();
+
+    const char* data = nullptr;
+    size_t      size = 0;
+#ifdef _WIN32
+    void* file    = nullptr;
+    void* mapping = nullptr;
+#else
+    int fd = -1;
+#endif
+
+    std::vector<LogFileRecord::Site>    m_sites;
+    std::vector<detail::BinaryLogBlock> blocks;
+    std::vector<int64_t>                prefix_max;  // max time of blocks[0..i]
+    std::vector<int64_t>                suffix_min;  // min time of blocks[i..]
+};
+
+
+class LogRingReader;
+
+/**
+ * @brief LogRingRecord is a view of a record in a shared memory log ring.
+ * @details It is valid until LogRingReader::pop() is called.
+ */
+class LogRingRecord {
+public:
+    std::chrono::system_clock::time_point time() const;
+    int64_t                               nanoseconds() const { return header()->time; }
+    unsigned                              thread() const { return header()->thread; }
+    const LogFileRecord::Site&            site() const;
+    unsigned                              pid() const;
+
+    unsigned    fields() const { return header()->fields; }
+    FieldType   type(unsigned index) const;
+    std::string field(unsigned index) const;
+
+    // get the field with the name, an empty string is returned if not found
+    std::string get(const std::string& name) const;
+
+    // the message with all fields filled in
+    std::string str() const;
+
+    bool valid() const { return p != nullptr; }
+
+    friend class LogRingReader;
+
+protected:
+    const detail::BinaryLogRecord* header() const {
+        return reinterpret_cast<const detail::BinaryLogRecord*>(p);
+    }
+    const char* find(unsigned index, uint8_t& type, uint32_t& size) const;
+
+    const LogRingReader* reader = nullptr;
+    const char*          p      = nullptr;
+};
+
+/**
+ * @brief LogRingReader attaches to a shared memory log ring as its consumer.
+ * @details The log messages of a producer can be read without any formatting or
+ * disk I/O in the producer. Only one reader should be attached to a ring.
+ *
+ * For example:
+ *   // in the worker processes
+ *   LogStream::getDefault().setSharedMemoryLogger("worker-1");
+ *
+ *   // in the consumer process
+ *   LogRingReader reader("worker-1");
+ *   while (running) {
+ *       for (LogRingRecord p = reader.peek(); p.valid(); p = reader.peek()) {
+ *           std::cout << p.str() << std::endl;
+ *           reader.pop();
+ *       }
+ *       std::this_thread::sleep_for(std::chrono::milliseconds(10));
+ *   }
+ */
+class LogRingReader {
+public:
+    LogRingReader(std::string name);
+    ~LogRingReader();
+
+    LogRingReader(const LogRingReader&)            = delete;
+    LogRingReader& operator=(const LogRingReader&) = delete;
+
+    /**
+     * @brief get the oldest record not consumed yet, the record is invalid if the ring is empty
+     */
+    LogRingRecord peek();
+
+    /**
+     * @brief consume the record returned by peek()
+     */
+    void pop();
+
+    uint64_t    dropped() const { return header->dropped.load(std::memory_order_relaxed); }
+    unsigned    pid() const { return static_cast<unsigned>(header->pid); }
+    std::string name() const { return m_name; }
+
+    const std::vector<LogFileRecord::Site>& sites() const { return m_sites; }
+
+    friend class LogRingRecord;
+
+protected:
+    void load_sites();
+
+    std::string                      m_name;
+    detail::LogRingHeader*           header = nullptr;
+    const char*                      site_area;
+    const char*                      ring_area;
+    size_t                           size       = 0;
+    uint64_t                         site_read  = 0;
+    uint64_t                         current    = 0;  // size of the record returned by peek
+    std::vector<LogFileRecord::Site> m_sites;
+};
+
+}  // namespace zeroerr
+
+ZEROERR_SUPPRESS_COMMON_WARNINGS_POP
@@ -0,0 +1,170 @@
+#pragma once
+#include "zeroerr/internal/config.h"
+
+#include "zeroerr/internal/threadsafe.h"
+#include "zeroerr/log.h"
+
+#include <cmath>
+#include <cstdint>
+#include <string>
+
+ZEROERR_SUPPRESS_COMMON_WARNINGS_PUSH
+
+// clang-format off
+#define ZEROERR_COUNTER(...)   ZEROERR_SUPPRESS_VARIADIC_MACRO ZEROERR_EXPAND(ZEROERR_METRIC_(COUNTER_m, add, __VA_ARGS__)) ZEROERR_SUPPRESS_VARIADIC_MACRO_POP
+#define ZEROERR_GAUGE(...)     ZEROERR_SUPPRESS_VARIADIC_MACRO ZEROERR_EXPAND(ZEROERR_METRIC_(GAUGE_m, set, __VA_ARGS__)) ZEROERR_SUPPRESS_VARIADIC_MACRO_POP
+#define ZEROERR_HISTOGRAM(...) ZEROERR_SUPPRESS_VARIADIC_MACRO ZEROERR_EXPAND(ZEROERR_METRIC_(HISTOGRAM_m, observe, __VA_ARGS__)) ZEROERR_SUPPRESS_VARIADIC_MACRO_POP
+// clang-format on
+
+#define ZEROERR_METRIC_(type, action, name, ...)                                          \
+    do {                                                                                  \
+        static zeroerr::Metric metric_site{__FILE__, __func__, name, ZEROERR_LOG_CATEGORY, \
+                                           __LINE__, zeroerr::MetricType::type};          \
+        metric_site.action(__VA_ARGS__);                                                  \
+    } while (0)
+
+namespace zeroerr {
+
+enum MetricType { COUNTER_m, GAUGE_m, HISTOGRAM_m };
+
+/**
+ * @brief Metric is the static per-site storage of a numeric metric.
+ * @details Each ZEROERR_COUNTER, ZEROERR_GAUGE or ZEROERR_HISTOGRAM site owns one
+ * static Metric, which is registered into a global list when the site is first reached.
+ * Samples are written into one of the shards chosen by the calling thread, so threads
+ * rarely touch the same cache line. Nothing is formatted on the hot path, all the shards
+ * are merged when a snapshot is taken by writeMetrics().
+ *
+ * For example:
+ *   void handle(Request& req) {
+ *       ZEROERR_COUNTER("requests_total");        // add 1
+ *       ZEROERR_COUNTER("bytes_total", req.size); // add n
+ *       ZEROERR_GAUGE("queue_depth", queue.size());
+ *       ZEROERR_HISTOGRAM("latency_us", elapsed);
+ *   }
+ *
+ * Histograms use log-linear buckets: each power of two is split into
+ * `sub_buckets` linear buckets, which keeps the relative error under 12.5%.
+ */
+class Metric {
+public:
+    static constexpr unsigned shards      = 8;
+    static constexpr unsigned sub_buckets = 4;
+    static constexpr int      min_exp     = -9;  // values up to 2^-10 fall into the first bucket
+    static constexpr int      groups      = 42;  // values above 2^32 fall into the last bucket
+    static constexpr unsigned buckets     = groups * sub_buckets + 2;
+
+    Metric(const char* filename, const char* function, const char* name, const char* category,
+           unsigned line, MetricType type);
+    ~Metric();
+
+    Metric(const Metric&)            = delete;
+    Metric& operator=(const Metric&) = delete;
+
+    void add(int64_t n = 1) {
+#ifdef ZEROERR_NO_THREAD_SAFE
+        shard().count += n;
+#else
+        shard().count.fetch_add(n, std::memory_order_relaxed);
+#endif
+    }
+
+    void set(double value) {
+#ifdef ZEROERR_NO_THREAD_SAFE
+        gauge = value;
+#else
+        gauge.store(value, std::memory_order_relaxed);
+#endif
+    }
+
+    void observe(double value) {
+        Shard& s = shard();
+#ifdef ZEROERR_NO_THREAD_SAFE
+        histogram[&s - data][bucket_index(value)]++;
+        s.count++;
+        s.sum += value;
+#else
+        histogram[&s - data][bucket_index(value)].fetch_add(1, std::memory_order_relaxed);
+        s.count.fetch_add(1, std::memory_order_relaxed);
+        double sum = s.sum.load(std::memory_order_relaxed);
+        while (!s.sum.compare_exchange_weak(sum, sum + value, std::memory_order_relaxed)) {
+        }
+#endif
+    }
+
+    /**
+     * @brief get the bucket that a sample falls into
+     */
+    static unsigned bucket_index(double value) {
+        if (!(value > std::ldexp(1.0, min_exp - 1))) return 0;  // also catches NaN
+        int    exp;
+        double mantissa = std::frexp(value, &exp);  // value = mantissa * 2^exp, mantissa in [0.5, 1)
+        double pos      = (mantissa - 0.5) * 2 * sub_buckets;
+        unsigned sub    = static_cast<unsigned>(pos);
+        unsigned index  = 1 + static_cast<unsigned>(exp - min_exp) * sub_buckets + sub;
+        if (pos == sub) index--;  // the upper bound of a bucket is inclusive
+        return index < buckets - 1 ? index : buckets - 1;
+    }
+
+    /**
+     * @brief get the inclusive upper bound of a bucket, the last bucket is unbounded
+     */
+    static double bucket_upper_bound(unsigned index) {
+        if (index == 0) return std::ldexp(1.0, min_exp - 1);
+        if (index >= buckets - 1) return HUGE_VAL;
+        unsigned group = (index - 1) / sub_buckets, sub = (index - 1) % sub_buckets;
+        return std::ldexp(0.5 + 0.5 * (sub + 1) / sub_buckets, static_cast<int>(group) + min_exp);
+    }
+
+    int64_t  counter_value() const;
+    double   gauge_value() const;
+    uint64_t histogram_count() const;
+    double   histogram_sum() const;
+    uint64_t histogram_bucket(unsigned index) const;
+
+    // meta data of this metric, the message of the log info is the metric name
+    LogInfo    info;
+    MetricType type;
+    Metric*    next = nullptr;
+
+protected:
+    struct alignas(64) Shard {
+        ZEROERR_ATOMIC(int64_t) count;
+        ZEROERR_ATOMIC(double) sum;
+        Shard() : count(0), sum(0) {}
+    };
+
+    Shard& shard() { return data[detail::current_thread_id() % shards]; }
+
+    Shard data[shards];
+    ZEROERR_ATOMIC(double) gauge;
+    ZEROERR_ATOMIC(uint64_t) (*histogram)[buckets] = nullptr;
+};
+
+
+/**
+ * @brief push a snapshot of all registered metrics into the stream
+ * @details The snapshot starts with a SCOPE_BEGIN_e record and ends with a SCOPE_END_e
+ * record. Metrics sharing a name are merged. Use LogStream::setMetricsLogger to write
+ * the snapshot in the text exposition format.
+ */
+extern void writeMetrics(LogStream& stream);
+
+/**
+ * @brief write a snapshot of all metrics to a file periodically in a background thread
+ * @param name The file, which is replaced atomically on each snapshot
+ * @param interval The interval in seconds
+ *
+ * With ZEROERR_NO_THREAD_SAFE there is no background thread and only the
+ * final snapshot is written by stopMetricsExporter().
+ */
+extern void startMetricsExporter(std::string name, double interval = 10.0);
+
+/**
+ * @brief stop the background exporter, a final snapshot is written before it returns
+ */
+extern void stopMetricsExporter();
+
+}  // namespace zeroerr
+
+ZEROERR_SUPPRESS_COMMON_WARNINGS_POP
@@ -4,6 +4,11 @@
 #include "zeroerr/color.h"
 #include "zeroerr/internal/typetraits.h"
 
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <typeinfo>
+
 #ifdef __GNUG__
 #include <cxxabi.h>
 #endif
@@ -31,7 +36,7 @@ constexpr unsigned max_rank = 5;
 
 struct Printer;
 template <typename T>
-void PrinterExt(Printer&, T, unsigned, const char*, rank<0>);
+void PrinterExt(Printer&, const T&, unsigned, const char*, rank<0>);
 
 namespace detail {
 
@@ -52,96 +57,163 @@ struct has_extension<T, has_printer_ext<T>> : std::true_type {};
 }  // namespace detail
 
 
+namespace detail {
+
+/**
+ * @brief demangle a type name once and keep it in a process-wide cache
+ * @details Each thread keeps its own map in front of the shared one, so after the first
+ * lookup of a type in a thread it costs neither a lock nor an allocation.
+ */
+extern const char* demangleCached(const std::type_info& info);
+
+/**
+ * @brief StringSink is a streambuf appending to a std::string.
+ * @details It has no put area and no seek support, so it is much cheaper to construct
+ * than std::stringbuf and can write into a buffer owned by the caller.
+ */
+class StringSink : public std::streambuf {
+public:
+    explicit StringSink(std::string* out) : out(out) {}
+
+    std::string* out;
+
+protected:
+    int_type overflow(int_type ch) override {
+        if (traits_type::eq_int_type(ch, traits_type::eof())) return traits_type::not_eof(ch);
+        out->push_back(traits_type::to_char_type(ch));
+        return ch;
+    }
+    std::streamsize xsputn(const char* s, std::streamsize n) override {
+        out->append(s, static_cast<size_t>(n));
+        return n;
+    }
+};
+
+}  // namespace detail
+
+
 /**
  * @brief A functor class Printer for printing a value of any type.
  *
  * This class can print values with all basic types, pointers, STL containers, tuple, optional, and
  * variant values. Any class that is streamable can be printed. POD structs can be supported using
  * third-party library Boost.PFR and enum can be supported using magic_enum.
+ *
+ * The values are passed by const reference. A Printer either writes to a stream, or into a
+ * string buffer which is its own or given by the caller, e.g.
+ * ```
+ * std::string out;
+ * Printer print(out);
+ * print(value);  // appended to out
+ * ```
+ * A buffer Printer lives on the stack and does not allocate until something is printed.
  */
 struct Printer {
     template <typename... Args>
-    Printer& operator()(Args&&... args) {
+    Printer& operator()(const Args&... args) {
         check_stream();
-        call(std::forward<Args>(args)...);
+        call(args...);
         return *this;
     }
     template <typename T>
     Printer& operator()(std::initializer_list<T>&& value) {
         check_stream();
-        call(std::forward<decltype(value)>(value));
+        call(value);
         return *this;
     }
 
     void check_stream() {
-        if (use_stringstream && clear_stream_before_printing) {
-            auto& ss = static_cast<std::stringstream&>(os);
-            ss.str(std::string());
-            ss.clear();
-        }
+        if (use_stringstream && clear_stream_before_printing) sink.out->clear();
     }
 
     template <typename T, typename... V>
-    void call(T value, V... others) {
-        PrinterExt(*this, std::forward<T>(value), 0, " ", rank<max_rank>{});
-        call(std::forward<V>(others)...);
+    void call(const T& value, const V&... others) {
+        PrinterExt(*this, value, 0, " ", rank<max_rank>{});
+        call(others...);
     }
 
     template <typename T>
-    void call(T value) {
-        PrinterExt(*this, std::forward<T>(value), 0, "", rank<max_rank>{});
+    void call(const T& value) {
+        PrinterExt(*this, value, 0, "", rank<max_rank>{});
         os << line_break;
         os.flush();
     }
 
-    Printer(std::ostream& os) : os(os) {}
-    Printer() : os(*new std::stringstream()) { use_stringstream = true; }
-    ~Printer() {
-        if (use_stringstream) delete &os;
+    Printer(std::ostream& os) : sink(&buffer), stream(&sink), os(os) {}
+    Printer() : sink(&buffer), stream(&sink), os(stream) { use_stringstream = true; }
+    // print into the buffer of the caller, it is appended and never cleared by the Printer
+    explicit Printer(std::string& out) : sink(&out), stream(&sink), os(stream) {
+        use_stringstream             = true;
+        clear_stream_before_printing = false;
     }
-
+    Printer(const Printer& other)
+        : buffer(other.buffer),
+          sink(other.sink.out == &other.buffer ? &buffer : other.sink.out),
+          stream(&sink),
+          isColorful(other.isColorful),
+          isCompact(other.isCompact),
+          isQuoted(other.isQuoted),
+          indent(other.indent),
+          line_break(other.line_break),
+          os(other.use_stringstream ? stream : other.os),
+          use_stringstream(other.use_stringstream),
+          clear_stream_before_printing(other.clear_stream_before_printing) {}
+    Printer& operator=(const Printer&) = delete;
+
+private:
+    std::string        buffer;
+    detail::StringSink sink;
+    std::ostream       stream;
+
+public:
     bool          isColorful = true;   // colorful output
     bool          isCompact  = false;  // compact mode
     bool          isQuoted   = true;   // string is quoted
     int           indent     = 2;
     const char*   line_break = "\n";
     std::ostream& os;
-    bool          use_stringstream             = false;
+    bool          use_stringstream             = false;  // writes into a string buffer
     bool          clear_stream_before_printing = true;
 
     template <class T>
     static std::string type(const T& t) {
-        return demangle(typeid(t).name());
+        return typeName(t);
+    }
+
+    // the demangled name of the dynamic type, it is cached and valid until the program exits
+    template <class T>
+    static const char* typeName(const T& t) {
+        return detail::demangleCached(typeid(t));
     }
 
 #if defined(ZEROERR_ENABLE_MAGIC_ENUM) && (ZEROERR_CXX_STANDARD >= 17)
     ZEROERR_ENABLE_IF(ZEROERR_IS_ENUM)
-    print(T value, unsigned level, const char* lb, rank<0>) { os << tab(level) << magic_enum::enum_name(value) << lb; }
+    print(const T& value, unsigned level, const char* lb, rank<0>) { os << tab(level) << magic_enum::enum_name(value) << lb; }
 #else
     ZEROERR_ENABLE_IF(ZEROERR_IS_ENUM)
-    print(T value, unsigned level, const char* lb, rank<0>) { os << tab(level) << value << lb; }
+    print(const T& value, unsigned level, const char* lb, rank<0>) { os << tab(level) << value << lb; }
 #endif
 
     ZEROERR_ENABLE_IF(ZEROERR_IS_INT || ZEROERR_IS_FLOAT)
-    print(T value, unsigned level, const char* lb, rank<0>) { os << tab(level) << value << lb; }
+    print(const T& value, unsigned level, const char* lb, rank<0>) { os << tab(level) << value << lb; }
 
     ZEROERR_ENABLE_IF(ZEROERR_IS_POINTER)
-    print(T value, unsigned level, const char* lb, rank<0>) {
+    print(const T& value, unsigned level, const char* lb, rank<0>) {
         if (value == nullptr)
             os << tab(level) << "nullptr" << lb;
         else
-            os << tab(level) << "<" << type(value) << " at " << static_cast<const void*>(value) << ">" << lb;
+            os << tab(level) << "<" << typeName(value) << " at " << static_cast<const void*>(value) << ">" << lb;
     }
 
 
     ZEROERR_ENABLE_IF(ZEROERR_IS_CLASS)
-    print(T value, unsigned level, const char* lb, rank<0>) {
-        os << tab(level) << type(value) << lb;
+    print(const T& value, unsigned level, const char* lb, rank<0>) {
+        os << tab(level) << typeName(value) << lb;
     }
 
 
     ZEROERR_ENABLE_IF(ZEROERR_IS_CHAR || ZEROERR_IS_WCHAR)
-    print(T value, unsigned level, const char* lb, rank<1>) {
+    print(const T& value, unsigned level, const char* lb, rank<1>) {
         os << tab(level) << '\'' << value << '\'' << lb;
     }
 
@@ -162,12 +234,12 @@ struct Printer {
 #endif
 
     ZEROERR_ENABLE_IF(ZEROERR_IS_BOOL)
-    print(T value, unsigned level, const char* lb, rank<2>) {
+    print(const T& value, unsigned level, const char* lb, rank<2>) {
         os << tab(level) << (value ? "true" : "false") << lb;
     }
 
     ZEROERR_ENABLE_IF(ZEROERR_IS_CLASS && ZEROERR_IS_STREAMABLE)
-    print(T value, unsigned level, const char* lb, rank<2>) { os << tab(level) << value << lb; }
+    print(const T& value, unsigned level, const char* lb, rank<2>) { os << tab(level) << value << lb; }
 
 
     ZEROERR_ENABLE_IF(ZEROERR_IS_CONTAINER)
@@ -194,11 +266,11 @@ struct Printer {
 
 
     ZEROERR_ENABLE_IF(ZEROERR_IS_AUTOPTR)
-    print(T value, unsigned level, const char* lb, rank<3>) {
+    print(const T& value, unsigned level, const char* lb, rank<3>) {
         if (value.get() == nullptr)
             os << tab(level) << "nullptr" << lb;
         else
-            os << tab(level) << "<" << type(value) << " at " << value.get() << ">" << lb;
+            os << tab(level) << "<" << typeName(value) << " at " << value.get() << ">" << lb;
     }
 
     ZEROERR_ENABLE_IF(ZEROERR_IS_CONTAINER && ZEROERR_IS_MAP)
@@ -215,15 +287,21 @@ struct Printer {
     }
 
     ZEROERR_ENABLE_IF(ZEROERR_IS_COMPLEX)
-    print(T value, unsigned level, const char* lb, rank<4>) {
+    print(const T& value, unsigned level, const char* lb, rank<4>) {
         os << tab(level) << "(" << value.real() << "+" << value.imag() << "i)" << lb;
     }
 
     ZEROERR_ENABLE_IF(ZEROERR_IS_STRING)
-    print(T value, unsigned level, const char* lb, rank<4>) {
+    print(const T& value, unsigned level, const char* lb, rank<4>) {
         os << tab(level) << quote() << value << quote() << lb;
     }
 
+    // an array is printed as the pointer it decays to, and a char array as a string
+    template <class T, size_t N>
+    void print(const T (&value)[N], unsigned level, const char* lb, rank<max_rank>) {
+        print(static_cast<const T*>(value), level, lb, rank<max_rank>{});
+    }
+
     template <class TupType>
     inline void print_tuple(const TupType&, unsigned, const char*, detail::seq<>) {}
 
@@ -259,7 +337,7 @@ struct Printer {
     std::string str() const {
         if (use_stringstream == false)
             throw std::runtime_error("Printer is not using stringstream");
-        return static_cast<std::stringstream&>(os).str();
+        return *sink.out;
     }
     operator std::string() const { return str(); }
 
@@ -286,8 +364,8 @@ struct Printer {
  * @param r  the rank of the rule. 0 is lowest priority.
  */
 template <class T>
-void PrinterExt(Printer& P, T v, unsigned level, const char* lb, rank<0>) {
-    P.print(std::forward<T>(v), level, lb, rank<max_rank>{});
+void PrinterExt(Printer& P, const T& v, unsigned level, const char* lb, rank<0>) {
+    P.print(v, level, lb, rank<max_rank>{});
 }
 
 extern Printer& getStdoutPrinter();
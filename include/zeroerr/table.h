@@ -136,12 +136,12 @@ public:
 protected:
     ZEROERR_ENABLE_IF(!ZEROERR_IS_CONTAINER)
     _push_back(rank<0>, std::vector<std::string>& row, T&& t) {
-        Printer print;
+        row.emplace_back();
+        Printer print(row.back());
         print.isCompact  = true;
         print.isQuoted   = false;
         print.line_break = "";
-        print(std::forward<T>(t));
-        row.push_back(print.str());
+        print(t);
     }
 
     ZEROERR_ENABLE_IF(ZEROERR_IS_STRING)
@@ -152,12 +152,12 @@ protected:
     ZEROERR_ENABLE_IF(ZEROERR_IS_CONTAINER)
     _push_back(rank<1>, std::vector<std::string>& row, const T& t) {
         for (auto& ele : t) {
-            Printer print;
+            row.emplace_back();
+            Printer print(row.back());
             print.isCompact  = true;
             print.isQuoted   = false;
             print.line_break = "";
             print(ele);
-            row.push_back(print.str());
         }
     }
 
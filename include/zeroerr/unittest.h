@@ -3,18 +3,26 @@
 #include "zeroerr/internal/config.h"
 
 #include <chrono>
+#include <cstdint>
 #include <functional>
+#include <memory>
 #include <string>
 #include <vector>
 
+#ifndef ZEROERR_NO_THREAD_SAFE
+#include <atomic>
+#include <exception>
+#include <thread>
+#endif
+
 ZEROERR_SUPPRESS_COMMON_WARNINGS_PUSH
 
-#define ZEROERR_CREATE_TEST_FUNC(function, name, ...)                          \
-    ZEROERR_SUPPRESS_COMMON_WARNINGS_PUSH                                      \
-    static void                     function(zeroerr::TestContext*);           \
-    static zeroerr::detail::regTest ZEROERR_NAMEGEN(_zeroerr_reg)(             \
-        zeroerr::TestCase(name, __FILE__, __LINE__, function, {__VA_ARGS__})); \
-    ZEROERR_SUPPRESS_COMMON_WARNINGS_POP;                                      \
+#define ZEROERR_CREATE_TEST_FUNC(function, name, ...)                                       \
+    ZEROERR_SUPPRESS_COMMON_WARNINGS_PUSH                                                   \
+    static void                     function(zeroerr::TestContext*);                        \
+    static zeroerr::detail::regTest ZEROERR_NAMEGEN(_zeroerr_reg)(name, __FILE__, __LINE__, \
+                                                                  function, {__VA_ARGS__}); \
+    ZEROERR_SUPPRESS_COMMON_WARNINGS_POP;                                                   \
     static void function(ZEROERR_UNUSED(zeroerr::TestContext* _ZEROERR_TEST_CONTEXT))
 
 #define TEST_CASE(...) \
@@ -39,8 +47,7 @@ ZEROERR_SUPPRESS_COMMON_WARNINGS_PUSH
         instance.funcname(_ZEROERR_TEST_CONTEXT);                                            \
     }                                                                                        \
     static zeroerr::detail::regTest ZEROERR_NAMEGEN(_zeroerr_reg)(                           \
-        zeroerr::TestCase(name, __FILE__, __LINE__, ZEROERR_CAT(call_, funcname),            \
-                          {__VA_ARGS__}));                                                   \
+        name, __FILE__, __LINE__, ZEROERR_CAT(call_, funcname), {__VA_ARGS__});              \
     inline void classname::funcname(ZEROERR_UNUSED(zeroerr::TestContext* _ZEROERR_TEST_CONTEXT))
 
 #define TEST_CASE_FIXTURE(fixture, ...)                                              \
@@ -62,6 +69,52 @@ namespace zeroerr {
 class IReporter;
 struct TestCase;
 class Decorator;
+class LogStream;
+struct AssertionData;
+
+namespace detail {
+
+struct ThreadCounts;
+struct ThreadFailure;
+
+#ifndef ZEROERR_NO_THREAD_SAFE
+/**
+ * @brief ThreadResults collects the assertions of the other threads while a test case runs.
+ * Each thread counts in its own ThreadCounts and pushes the output of its failed assertions
+ * to a lock-free list, both are merged into the TestContext when the test case ends.
+ */
+struct ThreadResults {
+    std::thread::id             owner;  // the thread running the test case
+    uint64_t                    epoch;  // tells the runs apart for the counters cached by threads
+    std::atomic<ThreadCounts*>  counts{nullptr};
+    std::atomic<ThreadFailure*> failures{nullptr};
+    std::atomic<int>            fatal{0};  // 1 while error is stored, 2 stored, 3 thrown
+    std::exception_ptr          error;     // the first failed REQUIRE of the other threads
+};
+#else
+struct ThreadResults;
+#endif
+
+/**
+ * @brief AssertionScope keeps capturing the output of a failed assertion in another thread
+ * until the assertion ends, the output is added to the test case when it ends.
+ */
+class AssertionScope {
+public:
+    AssertionScope(ThreadFailure* failure = nullptr) : failure(failure) {}
+    AssertionScope(AssertionScope&& other) : failure(other.failure) { other.failure = nullptr; }
+    AssertionScope(const AssertionScope&)            = delete;
+    AssertionScope& operator=(const AssertionScope&) = delete;
+    ~AssertionScope() {
+        if (failure) finish();
+    }
+
+private:
+    void           finish();
+    ThreadFailure* failure;
+};
+
+}  // namespace detail
 
 /**
  * @brief TestContext is a class that holds the test results and reporter context.
@@ -74,6 +127,10 @@ class Decorator;
  * * warning_as: Number of tests that passed with warning in assertion
  * * failed_as : Number of failed tests in assertion
  * * skipped_as: Number of skipped tests in assertion
+ *
+ * The assertions can be used in the threads started by a test case, they are counted by
+ * each thread and merged when the test case ends. The threads must be joined before the test
+ * case ends, see worker() for REQUIRE.
  */
 class TestContext {
 public:
@@ -90,6 +147,37 @@ public:
 
     IReporter& reporter;
 
+    // the assertions of the other threads while the test case runs, nullptr otherwise
+    detail::ThreadResults* threads = nullptr;
+
+    // the logs of the thread running the test case, kept for the reporter with log_to_report
+    std::shared_ptr<LogStream> log;
+
+    /**
+     * @brief Whether the assertion is in a thread other than the one running the test case.
+     * A failed REQUIRE of another thread is thrown here in the thread of the test case, so
+     * the test case stops at its next assertion.
+     */
+    bool otherThread() {
+#ifndef ZEROERR_NO_THREAD_SAFE
+        if (threads == nullptr) return false;
+        if (std::this_thread::get_id() != threads->owner) return true;
+        if (threads->fatal.load(std::memory_order_acquire) == 2) propagate();
+#endif
+        return false;
+    }
+
+    /**
+     * @brief Count an assertion of another thread in the counters of that thread.
+     * @return The scope capturing the output of the assertion if it failed.
+     */
+    detail::AssertionScope countInThread(const AssertionData& data);
+
+    /**
+     * @brief Throw the failed REQUIRE of another thread in the thread of the test case.
+     */
+    void propagate();
+
     /**
      * @brief Add the subtest results to the matrices.
      * @param local The local test context that will be added to the global context.
@@ -128,6 +216,25 @@ public:
  * * reporter_name   : The name of the reporter that will be used to report the test results.
  * * binary          : The binary name that will be used to run the test.
  * * filters         : The filters that will be used to filter the test cases.
+ * * jobs            : The number of threads running the test cases, 0 for all cores.
+ * * isolate         : If true, the test cases run in child processes, a crash only fails
+ *                     its test case. jobs is the number of the processes.
+ * * isolate_each    : If true, each test case runs in a new child process.
+ * * shard_index     : The shard to run, from 0 to shard_count - 1.
+ * * shard_count     : The number of shards, the test cases are split by their durations.
+ * * history_path    : The file keeping the results of the previous runs.
+ * * regression_threshold : Report the test cases slower than the history by this ratio.
+ * * rerun_failed    : If true, only the test cases failed in the last run are run.
+ * * changed_only    : If true, only the test cases whose sources changed since they passed
+ *                     are run.
+ * * deps_path       : The dependency files of the compiler (or a directory of them), a test
+ *                     case also depends on the files included by its source.
+ * * capture_fd      : If true, the file descriptors 1 and 2 are captured, so printf and the
+ *                     child processes are in the output of the test case (Unix only).
+ * * timeout         : The time limit of each test case in seconds, 0 for none. A test case
+ *                     running over it is stopped, timeout() only fails a slow test case.
+ * * args_error      : The error of the arguments given to parseArgs, run() prints it and
+ *                     fails without running the test cases.
  */
 struct UnitTest {
     /**
@@ -140,7 +247,7 @@ struct UnitTest {
 
     /**
      * @brief Run the test.
-     * @return int 0 if the test passed.
+     * @return int 0 if the test passed, 2 if the arguments are wrong.
      */
     int run();
 
@@ -152,16 +259,32 @@ struct UnitTest {
      */
     bool run_filter(const TestCase& tc);
 
-    bool            silent          = false;
-    bool            run_bench       = false;
-    bool            run_fuzz        = false;
-    bool            list_test_cases = false;
-    bool            no_color        = false;
-    bool            log_to_report   = false;
-    std::string     correct_output_path;
-    std::string     reporter_name = "console";
-    std::string     binary;
-    struct Filters* filters;
+    bool                silent               = false;
+    bool                run_bench            = false;
+    bool                run_fuzz             = false;
+    bool                list_test_cases      = false;
+    bool                no_color             = false;
+    bool                log_to_report        = false;
+    unsigned            assertion_report     = 0;  // rows of the assertion report, 0 for no report
+    unsigned            jobs                 = 1;
+    bool                isolate              = false;
+    bool                isolate_each         = false;
+    unsigned            shard_index          = 0;
+    unsigned            shard_count          = 1;
+    double              regression_threshold = 0.5;
+    bool                rerun_failed         = false;
+    bool                changed_only         = false;
+    bool                capture_fd           = false;
+    double              timeout              = 0;
+    std::string         history_path;
+    std::string         deps_path;
+    std::string         correct_output_path;
+    std::string         reporter_name = "console";
+    std::string         binary;
+    std::string         args_error;
+    struct Filters*     filters;
+    struct TestHistory* history  = nullptr;  // the records used by the running test
+    class Watchdog*     watchdog = nullptr;  // stops the hung test cases of the running test
 };
 
 /**
@@ -222,6 +345,23 @@ struct SubCase : TestCase {
 };
 
 
+namespace detail {
+// run the body of a thread started by a test case, a failed REQUIRE only stops the body
+extern void runWorker(const std::function<void()>& body);
+}  // namespace detail
+
+/**
+ * @brief Wrap the body of a thread started by a test case. A failed REQUIRE stops the body
+ * instead of terminating the program, and it is thrown again in the thread of the test case.
+ *
+ * Example:
+ *    std::thread t(zeroerr::worker([&] { REQUIRE(queue.pop() == 1); }));
+ */
+inline std::function<void()> worker(std::function<void()> body) {
+    return [body]() { detail::runWorker(body); };
+}
+
+
 template <typename T>
 struct TestedObjects {
     void           add(T&& obj) { objects.push_back(std::forward<T>(obj)); }
@@ -279,9 +419,20 @@ namespace detail {
 /**
  * @brief regTest is a class that is used to register the test case.
  * It will be used as global variables and the constructor will be called to register the test case.
+ * The constructor only links the record into a list, the records are sorted and turned into
+ * test cases once when the test cases are first used, so a large suite starts fast.
  */
 struct regTest {
-    explicit regTest(const TestCase& tc, TestType type = test_case);
+    regTest(const char* name, const char* file, unsigned line, void (*func)(TestContext*),
+            std::vector<Decorator*> decorators, TestType type = test_case);
+
+    const char*             name;
+    const char*             file;
+    unsigned                line;
+    void                    (*func)(TestContext*);
+    std::vector<Decorator*> decorators;
+    TestType                type;
+    regTest*                next;  // the record registered before it
 };
 
 /**
@@ -373,6 +524,7 @@ Decorator* skip(bool isSkip = true);
 Decorator* timeout(float timeout = 0.1f);  // in seconds
 Decorator* may_fail(bool isMayFail = true);
 Decorator* should_fail(bool isShouldFail = true);
+Decorator* serial(bool isSerial = true);  // not run with other test cases by --jobs
 
 }  // namespace zeroerr
 
@@ -0,0 +1,198 @@
+#include "zeroerr/internal/compare.h"
+
+#include <cmath>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define ZEROERR_COMPARE_SSE2
+#include <emmintrin.h>
+#if defined(__GNUC__) || defined(__clang__)
+// the AVX2 kernels are compiled with the target attribute and selected at runtime
+#define ZEROERR_COMPARE_AVX2
+#include <immintrin.h>
+#endif
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace zeroerr {
+
+namespace detail {
+
+// index of the lowest set bit, mask must not be zero
+static unsigned lowestBit(uint32_t mask) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return static_cast<unsigned>(index);
+#else
+    return static_cast<unsigned>(__builtin_ctz(mask));
+#endif
+}
+
+static size_t findMismatchBytesScalar(const unsigned char* a, const unsigned char* b, size_t i,
+                                      size_t n) {
+    for (; i + 8 <= n; i += 8) {
+        uint64_t x, y;
+        memcpy(&x, a + i, 8);
+        memcpy(&y, b + i, 8);
+        if (x != y) break;
+    }
+    for (; i < n; ++i)
+        if (a[i] != b[i]) return i;
+    return n;
+}
+
+template <typename T>
+static size_t findNotCloseScalar(const T* a, const T* b, size_t i, size_t n, T rtol, T atol) {
+    for (; i < n; ++i)
+        if (!(a[i] == b[i] || std::fabs(a[i] - b[i]) <= atol + rtol * std::fabs(b[i]))) return i;
+    return n;
+}
+
+#ifdef ZEROERR_COMPARE_AVX2
+static bool hasAVX2() {
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+    return avx2;
+}
+
+__attribute__((target("avx2"))) static size_t findMismatchBytesAVX2(const unsigned char* a,
+                                                                    const unsigned char* b,
+                                                                    size_t n) {
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i x    = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+        __m256i y    = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+        uint32_t eq  = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, y)));
+        if (eq != 0xFFFFFFFFu) return i + lowestBit(~eq);
+    }
+    return findMismatchBytesScalar(a, b, i, n);
+}
+
+__attribute__((target("avx2"))) static size_t findNotCloseAVX2(const float* a, const float* b,
+                                                               size_t n, float rtol, float atol) {
+    const __m256 sign = _mm256_set1_ps(-0.0f);
+    const __m256 vr   = _mm256_set1_ps(rtol);
+    const __m256 va   = _mm256_set1_ps(atol);
+    size_t       i    = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 x    = _mm256_loadu_ps(a + i);
+        __m256 y    = _mm256_loadu_ps(b + i);
+        __m256 diff = _mm256_andnot_ps(sign, _mm256_sub_ps(x, y));
+        __m256 tol  = _mm256_add_ps(va, _mm256_mul_ps(vr, _mm256_andnot_ps(sign, y)));
+        __m256 ok   = _mm256_or_ps(_mm256_cmp_ps(x, y, _CMP_EQ_OQ), _mm256_cmp_ps(diff, tol, _CMP_LE_OQ));
+        uint32_t mask = static_cast<uint32_t>(_mm256_movemask_ps(ok));
+        if (mask != 0xFFu) return i + lowestBit(~mask);
+    }
+    return findNotCloseScalar(a, b, i, n, rtol, atol);
+}
+
+__attribute__((target("avx2"))) static size_t findNotCloseAVX2(const double* a, const double* b,
+                                                               size_t n, double rtol,
+                                                               double atol) {
+    const __m256d sign = _mm256_set1_pd(-0.0);
+    const __m256d vr   = _mm256_set1_pd(rtol);
+    const __m256d va   = _mm256_set1_pd(atol);
+    size_t        i    = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256d x    = _mm256_loadu_pd(a + i);
+        __m256d y    = _mm256_loadu_pd(b + i);
+        __m256d diff = _mm256_andnot_pd(sign, _mm256_sub_pd(x, y));
+        __m256d tol  = _mm256_add_pd(va, _mm256_mul_pd(vr, _mm256_andnot_pd(sign, y)));
+        __m256d ok   = _mm256_or_pd(_mm256_cmp_pd(x, y, _CMP_EQ_OQ), _mm256_cmp_pd(diff, tol, _CMP_LE_OQ));
+        uint32_t mask = static_cast<uint32_t>(_mm256_movemask_pd(ok));
+        if (mask != 0xFu) return i + lowestBit(~mask);
+    }
+    return findNotCloseScalar(a, b, i, n, rtol, atol);
+}
+#endif
+
+#ifdef ZEROERR_COMPARE_SSE2
+static size_t findMismatchBytesSSE2(const unsigned char* a, const unsigned char* b, size_t n) {
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i  x  = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+        __m128i  y  = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+        uint32_t eq = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(x, y)));
+        if (eq != 0xFFFFu) return i + lowestBit(~eq);
+    }
+    return findMismatchBytesScalar(a, b, i, n);
+}
+
+static size_t findNotCloseSSE2(const float* a, const float* b, size_t n, float rtol, float atol) {
+    const __m128 sign = _mm_set1_ps(-0.0f);
+    const __m128 vr   = _mm_set1_ps(rtol);
+    const __m128 va   = _mm_set1_ps(atol);
+    size_t       i    = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128   x    = _mm_loadu_ps(a + i);
+        __m128   y    = _mm_loadu_ps(b + i);
+        __m128   diff = _mm_andnot_ps(sign, _mm_sub_ps(x, y));
+        __m128   tol  = _mm_add_ps(va, _mm_mul_ps(vr, _mm_andnot_ps(sign, y)));
+        __m128   ok   = _mm_or_ps(_mm_cmpeq_ps(x, y), _mm_cmple_ps(diff, tol));
+        uint32_t mask = static_cast<uint32_t>(_mm_movemask_ps(ok));
+        if (mask != 0xFu) return i + lowestBit(~mask);
+    }
+    return findNotCloseScalar(a, b, i, n, rtol, atol);
+}
+
+static size_t findNotCloseSSE2(const double* a, const double* b, size_t n, double rtol,
+                               double atol) {
+    const __m128d sign = _mm_set1_pd(-0.0);
+    const __m128d vr   = _mm_set1_pd(rtol);
+    const __m128d va   = _mm_set1_pd(atol);
+    size_t        i    = 0;
+    for (; i + 2 <= n; i += 2) {
+        __m128d  x    = _mm_loadu_pd(a + i);
+        __m128d  y    = _mm_loadu_pd(b + i);
+        __m128d  diff = _mm_andnot_pd(sign, _mm_sub_pd(x, y));
+        __m128d  tol  = _mm_add_pd(va, _mm_mul_pd(vr, _mm_andnot_pd(sign, y)));
+        __m128d  ok   = _mm_or_pd(_mm_cmpeq_pd(x, y), _mm_cmple_pd(diff, tol));
+        uint32_t mask = static_cast<uint32_t>(_mm_movemask_pd(ok));
+        if (mask != 0x3u) return i + lowestBit(~mask);
+    }
+    return findNotCloseScalar(a, b, i, n, rtol, atol);
+}
+#endif
+
+size_t findMismatchBytes(const void* a, const void* b, size_t n) {
+    const unsigned char* x = static_cast<const unsigned char*>(a);
+    const unsigned char* y = static_cast<const unsigned char*>(b);
+#ifdef ZEROERR_COMPARE_AVX2
+    if (hasAVX2()) return findMismatchBytesAVX2(x, y, n);
+#endif
+#ifdef ZEROERR_COMPARE_SSE2
+    return findMismatchBytesSSE2(x, y, n);
+#else
+    return findMismatchBytesScalar(x, y, 0, n);
+#endif
+}
+
+size_t findNotClose(const float* a, const float* b, size_t n, double rtol, double atol) {
+    float r = static_cast<float>(rtol), t = static_cast<float>(atol);
+#ifdef ZEROERR_COMPARE_AVX2
+    if (hasAVX2()) return findNotCloseAVX2(a, b, n, r, t);
+#endif
+#ifdef ZEROERR_COMPARE_SSE2
+    return findNotCloseSSE2(a, b, n, r, t);
+#else
+    return findNotCloseScalar(a, b, 0, n, r, t);
+#endif
+}
+
+size_t findNotClose(const double* a, const double* b, size_t n, double rtol, double atol) {
+#ifdef ZEROERR_COMPARE_AVX2
+    if (hasAVX2()) return findNotCloseAVX2(a, b, n, rtol, atol);
+#endif
+#ifdef ZEROERR_COMPARE_SSE2
+    return findNotCloseSSE2(a, b, n, rtol, atol);
+#else
+    return findNotCloseScalar(a, b, 0, n, rtol, atol);
+#endif
+}
+
+}  // namespace detail
+
+}  // namespace zeroerr
@@ -0,0 +1,77 @@
+#include "zeroerr/format.h"
+
+#include <cstdio>
+
+#if ZEROERR_CXX_STANDARD >= 17 && defined(__has_include)
+#if __has_include(<charconv>)
+#include <charconv>
+#define ZEROERR_HAS_TO_CHARS
+#endif
+#endif
+
+namespace zeroerr {
+
+namespace detail {
+
+void format_uint(std::string& out, uint64_t value) {
+#ifdef ZEROERR_HAS_TO_CHARS
+    char buf[24];
+    auto r = std::to_chars(buf, buf + sizeof(buf), value);
+    out.append(buf, r.ptr);
+#else
+    char  buf[24];
+    char* p = buf + sizeof(buf);
+    do {
+        *--p = static_cast<char>('0' + value % 10);
+        value /= 10;
+    } while (value);
+    out.append(p, buf + sizeof(buf));
+#endif
+}
+
+void format_int(std::string& out, int64_t value) {
+    if (value < 0) {
+        out += '-';
+        // negate in unsigned, INT64_MIN has no positive counterpart
+        format_uint(out, ~static_cast<uint64_t>(value) + 1);
+    } else {
+        format_uint(out, static_cast<uint64_t>(value));
+    }
+}
+
+void format_float(std::string& out, double value) {
+    // the same as the default format of std::ostream
+    char buf[32];
+#if defined(ZEROERR_HAS_TO_CHARS) && defined(__cpp_lib_to_chars)
+    auto r = std::to_chars(buf, buf + sizeof(buf), value, std::chars_format::general, 6);
+    out.append(buf, r.ptr);
+#else
+    int n = snprintf(buf, sizeof(buf), "%g", value);
+    out.append(buf, static_cast<size_t>(n));
+#endif
+}
+
+void format_args(std::string& out, const char* fmt, const FormatArg* args, unsigned n) {
+    unsigned    j = 0;
+    const char* i = fmt;
+    while (*i != '\0') {
+        // copy the text until the next placeholder at once
+        const char* e = i;
+        while (*e != '\0' && *e != '{' && *e != '}') e++;
+        out.append(i, e);
+        if (*e == '{')
+            while (*e != '\0' && *e != '}') e++;
+        if (*e == '\0') break;
+
+        // each '}' takes the next argument, the name in the braces is not used
+        if (j < n) {
+            args[j].print(out, args[j].value);
+            j++;
+        }
+        i = e + 1;
+    }
+}
+
+}  // namespace detail
+
+}  // namespace zeroerr
@@ -1,13 +1,23 @@
 #include "zeroerr/log.h"
 #include "zeroerr/internal/threadsafe.h"
+#include "zeroerr/logfile.h"
 
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <ctime>
 #include <iomanip>
+#include <stdexcept>
+#include <unordered_map>
 #include <unordered_set>
 
 #ifdef _WIN32
 #include <windows.h>
 #else
+#include <fcntl.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <unistd.h>
 #endif
 
 const char* ZEROERR_LOG_CATEGORY = "default";
@@ -19,20 +29,50 @@ int _ZEROERR_G_VERBOSE = 0;
 
 thread_local std::vector<IContextScope*> _ZEROERR_G_CONTEXT_SCOPE_VECTOR;
 
-static std::string       DefaultLogCallback(const LogMessage& msg, bool colorful);
-static LogCustomCallback log_custom_callback = DefaultLogCallback;
-void setLogCustomCallback(LogCustomCallback callback) { log_custom_callback = callback; }
+static void              DefaultLogCallback(const LogMessage& msg, bool colorful, std::string& out);
+static LogCustomCallback log_custom_callback = nullptr;
+static LogBufferCallback log_buffer_callback = DefaultLogCallback;
+void setLogCustomCallback(LogCustomCallback callback) {
+    log_custom_callback = callback;
+    log_buffer_callback = callback ? nullptr : DefaultLogCallback;
+}
+void setLogCustomCallback(LogBufferCallback callback) {
+    log_custom_callback = nullptr;
+    log_buffer_callback = callback ? callback : DefaultLogCallback;
+}
+
+// format the message by the custom callback into a buffer reused by the thread
+static const std::string& formatLogMessage(const LogMessage& msg, bool colorful) {
+    static thread_local std::string buffer;
+    if (log_custom_callback) {
+        buffer = log_custom_callback(msg, colorful);
+    } else {
+        buffer.clear();
+        log_buffer_callback(msg, colorful, buffer);
+    }
+    return buffer;
+}
+
+static const char* getShortFilename(const char* filename) {
+    const char* result = filename;
+    for (const char* p = filename; *p; p++)
+        if (*p == '/' || *p == '\\') result = p + 1;
+    return result;
+}
 
 
 LogInfo::LogInfo(const char* filename, const char* function, const char* message,
-                 const char* category, unsigned line, unsigned size, LogSeverity severity)
+                 const char* category, unsigned line, unsigned size, LogSeverity severity,
+                 LogEvent event)
     : filename(filename),
+      short_filename(getShortFilename(filename)),
       function(function),
       message(message),
       category(category),
       line(line),
       size(size),
       severity(severity),
+      event(event),
       names() {
     for (const char* p = message; *p; p++)
         if (*p == '{') {
@@ -47,6 +87,73 @@ LogInfo::LogInfo(const char* filename, const char* function, const char* message
 }
 
 
+namespace detail {
+// split the expressions of a dbg() call at the commas which are not nested
+static std::vector<std::string> splitExpressions(const char* exprs) {
+    std::vector<std::string> result(1);
+    int                      depth = 0;
+    char                     quote = 0;
+    for (const char* p = exprs; *p; p++) {
+        char c = *p;
+        if (quote) {
+            if (c == '\\' && p[1]) result.back() += *p++;
+            else if (c == quote) quote = 0;
+        } else if (c == '"' || c == '\'') {
+            quote = c;
+        } else if (c == '(' || c == '[' || c == '{') {
+            depth++;
+        } else if (c == ')' || c == ']' || c == '}') {
+            depth--;
+        } else if (c == ',' && depth == 0) {
+            result.emplace_back();
+            continue;
+        }
+        result.back() += c;
+    }
+    for (auto& expr : result) {
+        size_t b = expr.find_first_not_of(' '), e = expr.find_last_not_of(' ');
+        expr     = b == std::string::npos ? std::string() : expr.substr(b, e - b + 1);
+    }
+    return result;
+}
+
+// braces are placeholders in the message
+static void appendNoBraces(std::string& out, const std::string& text) {
+    for (char c : text) out += c == '{' ? '(' : c == '}' ? ')' : c;
+}
+
+const LogInfo& makeDebugInfo(const char* file, unsigned line, const char* func,
+                             const char* exprs, const char* category,
+                             const std::type_info* const* types, unsigned n, unsigned size) {
+    std::vector<std::string> names = splitExpressions(exprs);
+    if (names.size() != n) {
+        names.clear();
+        for (unsigned i = 0; i < n; i++) names.push_back(format("_{}", i));
+    }
+
+    // the message and the LogInfo are kept for the whole program like the static ones
+    std::string* message = new std::string();
+    for (unsigned i = 0; i < n; i++) {
+        if (i) *message += ", ";
+        appendNoBraces(*message, names[i]);
+    }
+    *message += " =";
+    for (unsigned i = 0; i < n; i++) {
+        *message += " {";
+        appendNoBraces(*message, names[i]);
+        *message += '}';
+    }
+    *message += " (";
+    for (unsigned i = 0; i < n; i++) {
+        if (i) *message += ", ";
+        appendNoBraces(*message, demangleCached(*types[i]));
+    }
+    *message += ')';
+    return *new LogInfo(file, func, message->c_str(), category, line, size, LogSeverity::LOG_l);
+}
+}  // namespace detail
+
+
 constexpr size_t LogStreamMaxSize = 1 * 1024 - 16;
 
 struct DataBlock {
@@ -119,8 +226,8 @@ void* LogStream::alloc_block_lockfree(unsigned size) {
                     last->size = 0;
                     prepare    = last;
                 } else {
-                    prepare->next = last;
-                    prepare       = new DataBlock();
+                    last->next = prepare;
+                    prepare    = new DataBlock();
                 }
             }
         }
@@ -140,15 +247,52 @@ LogIterator LogStream::current(std::string message, std::string function_name, i
 void LogStream::flush() {
     ZEROERR_LOCK(*mutex);
     DataBlock* last = ZEROERR_LOAD(m_last);
-    for (DataBlock* p = first; p != last; p = p->next) {
+    for (DataBlock* p = first; p != last;) {
+        DataBlock* next = p->next;
         logger->flush(p);
         delete p;
+        p = next;
     }
     logger->flush(last);
     last->size = 0;
     first      = last;
 }
 
+namespace detail {
+void print_int_field(const LogField& field, std::string& out) {
+    format_int(out, *(const int64_t*)field.value);
+}
+
+void print_uint_field(const LogField& field, std::string& out) {
+    format_uint(out, *(const uint64_t*)field.value);
+}
+
+void print_float_field(const LogField& field, std::string& out) {
+    format_float(out, *(const double*)field.value);
+}
+
+void print_bool_field(const LogField& field, std::string& out) {
+    out += *(const bool*)field.value ? "true" : "false";
+}
+
+void print_string_field(const LogField& field, std::string& out) {
+    out += '"';
+    out.append((const char*)field.value, field.size);
+    out += '"';
+}
+}  // namespace detail
+
+std::map<std::string, std::string> LogMessage::getData() const {
+    struct DataVisitor : FieldVisitor {
+        std::map<std::string, std::string> data;
+        void visit(const std::string& name, const LogField& field) override {
+            field.append(data[name]);
+        }
+    } visitor;
+    visit(visitor);
+    return visitor.data;
+}
+
 static LogMessage* moveBytes(LogMessage* p, unsigned size) {
     char* src = (char*)p;
     char* dst = src + size;
@@ -181,7 +325,8 @@ LogIterator::LogIterator(LogStream& stream, std::string message, std::string fun
       function_name_filter(function_name),
       message_filter(message),
       line_filter(line) {
-    while (!check_filter() && p) next();
+    skip_empty();
+    while (p && !check_filter()) next();
 }
 
 void LogIterator::check_at_safe_pos() {
@@ -191,19 +336,20 @@ void LogIterator::check_at_safe_pos() {
     }
 }
 
-void LogIterator::next() {
-    if (q < p->end()) {
-        q = moveBytes(q, q->info->size);
-        if (q >= p->end()) next();
-    } else {
+// move to the next block while the current one is exhausted, the last block
+// is empty after the stream is flushed
+void LogIterator::skip_empty() {
+    while (p && q >= p->end()) {
         p = p->next;
-        if (p)
-            q = p->begin();
-        else
-            q = nullptr;
+        q = p ? p->begin() : nullptr;
     }
 }
 
+void LogIterator::next() {
+    q = moveBytes(q, q->info->size);
+    skip_empty();
+}
+
 LogIterator& LogIterator::operator++() {
     do {
         next();
@@ -212,7 +358,7 @@ LogIterator& LogIterator::operator++() {
 }
 
 bool LogIterator::check_filter() {
-    if (!message_filter.empty() && startWith(q->info->message, message_filter)) return false;
+    if (!message_filter.empty() && !startWith(q->info->message, message_filter)) return false;
     if (!function_name_filter.empty() && q->info->function != function_name_filter) return false;
     if (line_filter != -1 && static_cast<int>(q->info->line) != line_filter) return false;
     return true;
@@ -227,7 +373,7 @@ public:
     void flush(DataBlock* msg) override {
         if (file) {
             for (auto p = msg->begin(); p < msg->end(); p = moveBytes(p, p->info->size)) {
-                auto ss = log_custom_callback(*p, false);
+                const std::string& ss = formatLogMessage(*p, false);
                 fwrite(ss.c_str(), ss.size(), 1, file);
             }
             fflush(file);
@@ -299,7 +445,7 @@ public:
     void flush(DataBlock* msg) override {
         FileCache cache;
         for (auto p = msg->begin(); p < msg->end(); p = moveBytes(p, p->info->size)) {
-            auto ss = log_custom_callback(*p, false);
+            const std::string& ss = formatLogMessage(*p, false);
 
             std::stringstream path;
             path << dirpath;
@@ -364,7 +510,7 @@ public:
 
     void flush(DataBlock* msg) override {
         for (auto p = msg->begin(); p < msg->end(); p = moveBytes(p, p->info->size)) {
-            os << log_custom_callback(*p, true);
+            os << formatLogMessage(*p, true);
         }
         os.flush();
     }
@@ -374,11 +520,568 @@ protected:
 };
 
 
+static void writeJsonString(FILE* file, const std::string& str) {
+    fputc('"', file);
+    for (char c : str) {
+        switch (c) {
+            case '"':  fputs("\\\"", file); break;
+            case '\\': fputs("\\\\", file); break;
+            case '\n': fputs("\\n", file); break;
+            case '\r': fputs("\\r", file); break;
+            case '\t': fputs("\\t", file); break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20)
+                    fprintf(file, "\\u%04x", static_cast<unsigned>(c));
+                else
+                    fputc(c, file);
+        }
+    }
+    fputc('"', file);
+}
+
+// Write the messages in Chrome Trace Event format (JSON array form), which can be
+// loaded by chrome://tracing and Perfetto. The closing bracket is written when the
+// logger is destroyed, but both viewers accept a file without it after a crash.
+class ChromeTraceLogger : public Logger {
+public:
+    ChromeTraceLogger(std::string name) {
+        file      = fopen(name.c_str(), "w");
+        args.file = file;
+        if (file) fputs("[", file);
+#ifdef _WIN32
+        pid = static_cast<unsigned long>(GetCurrentProcessId());
+#else
+        pid = static_cast<unsigned long>(getpid());
+#endif
+    }
+    ~ChromeTraceLogger() {
+        if (file) {
+            fputs("\n]\n", file);
+            fclose(file);
+        }
+    }
+
+    void flush(DataBlock* msg) override {
+        if (!file) return;
+        for (auto p = msg->begin(); p < msg->end(); p = moveBytes(p, p->info->size)) {
+            const char* phase = "i";
+            switch (p->info->event) {
+                case SCOPE_BEGIN_e: phase = "B"; break;
+                case SCOPE_END_e:   phase = "E"; break;
+                case INSTANT_e:     phase = "i"; break;
+                case METRIC_COUNTER_e:
+                case METRIC_GAUGE_e:
+                case METRIC_HISTOGRAM_e: phase = "C"; break;
+                case METRIC_BUCKET_e:    continue;
+            }
+            auto ts = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                          p->time.time_since_epoch())
+                          .count();
+
+            fputs(first ? "\n" : ",\n", file);
+            first = false;
+            fputs("{\"name\":", file);
+            writeJsonString(file, p->info->message);
+            fputs(",\"cat\":", file);
+            writeJsonString(file, p->info->category);
+            fprintf(file, ",\"ph\":\"%s\",\"ts\":%lld.%03lld,\"pid\":%lu,\"tid\":%u", phase,
+                    static_cast<long long>(ts / 1000), static_cast<long long>(ts % 1000), pid,
+                    p->thread);
+            if (p->info->event == INSTANT_e) fputs(",\"s\":\"t\"", file);
+            if (p->info->event != SCOPE_END_e && !p->info->names.empty()) {
+                fputs(",\"args\":{", file);
+                args.first   = true;
+                args.numeric = *phase == 'C';
+                p->visit(args);
+                fputc('}', file);
+            }
+            fputc('}', file);
+        }
+        fflush(file);
+    }
+
+protected:
+    // write the fields as the members of a JSON object
+    struct ArgsWriter : FieldVisitor {
+        FILE*       file;
+        bool        first, numeric;
+        std::string buffer;
+
+        void visit(const std::string& name, const LogField& field) override {
+            if (!first) fputc(',', file);
+            first = false;
+            writeJsonString(file, name);
+            fputc(':', file);
+            buffer.clear();
+            if (field.type == STRING_f) {
+                buffer.append(static_cast<const char*>(field.value), field.size);
+                writeJsonString(file, buffer);
+                return;
+            }
+            field.append(buffer);
+            // counter events carry numbers, which the viewers plot
+            if (numeric && (field.type == INT_f || field.type == UINT_f || field.type == FLOAT_f))
+                fputs(buffer.c_str(), file);
+            else
+                writeJsonString(file, buffer);
+        }
+    };
+
+    FILE*         file;
+    unsigned long pid;
+    bool          first = true;
+    ArgsWriter    args;
+};
+
+
+static void writeMetricValue(FILE* file, double value) {
+    if (std::isnan(value))
+        fputs("NaN", file);
+    else if (std::isinf(value))
+        fputs(value > 0 ? "+Inf" : "-Inf", file);
+    else {
+        char buf[32];
+        snprintf(buf, sizeof(buf), "%.15g", value);
+        if (strtod(buf, nullptr) != value) snprintf(buf, sizeof(buf), "%.17g", value);
+        fputs(buf, file);
+    }
+}
+
+// Write the metric snapshots in the Prometheus text exposition format. The records
+// of a snapshot are written to "<name>.tmp", which is renamed to the target file
+// when the end record of the snapshot arrives.
+class MetricsLogger : public Logger {
+public:
+    MetricsLogger(std::string name) : name(name), file(nullptr) {}
+    ~MetricsLogger() {
+        if (file) fclose(file);
+    }
+
+    void flush(DataBlock* msg) override {
+        for (auto p = msg->begin(); p < msg->end(); p = moveBytes(p, p->info->size)) {
+            switch (p->info->event) {
+                case INSTANT_e:
+                case SCOPE_BEGIN_e: break;
+                case SCOPE_END_e: finish(); break;
+                case METRIC_COUNTER_e: {
+                    auto& args = static_cast<LogMessageImpl<int64_t>*>(p)->args;
+                    if (!open()) break;
+                    fprintf(file, "# TYPE %s counter\n%s %lld\n", p->info->message,
+                            p->info->message, static_cast<long long>(std::get<0>(args)));
+                    break;
+                }
+                case METRIC_GAUGE_e: {
+                    auto& args = static_cast<LogMessageImpl<double>*>(p)->args;
+                    if (!open()) break;
+                    fprintf(file, "# TYPE %s gauge\n%s ", p->info->message, p->info->message);
+                    writeMetricValue(file, std::get<0>(args));
+                    fputc('\n', file);
+                    break;
+                }
+                case METRIC_HISTOGRAM_e: {
+                    auto& args = static_cast<LogMessageImpl<uint64_t, double>*>(p)->args;
+                    if (!open()) break;
+                    histogram = p->info->message;
+                    count     = std::get<0>(args);
+                    sum       = std::get<1>(args);
+                    fprintf(file, "# TYPE %s histogram\n", histogram);
+                    break;
+                }
+                case METRIC_BUCKET_e: {
+                    auto& args = static_cast<LogMessageImpl<double, uint64_t>*>(p)->args;
+                    if (!file || !histogram) break;
+                    fprintf(file, "%s_bucket{le=\"", histogram);
+                    writeMetricValue(file, std::get<0>(args));
+                    fprintf(file, "\"} %llu\n", static_cast<unsigned long long>(std::get<1>(args)));
+                    if (std::isinf(std::get<0>(args))) {
+                        fprintf(file, "%s_sum ", histogram);
+                        writeMetricValue(file, sum);
+                        fprintf(file, "\n%s_count %llu\n", histogram,
+                                static_cast<unsigned long long>(count));
+                        histogram = nullptr;
+                    }
+                    break;
+                }
+            }
+        }
+    }
+
+protected:
+    bool open() {
+        if (!file) file = fopen((name + ".tmp").c_str(), "w");
+        return file != nullptr;
+    }
+
+    void finish() {
+        if (!file) return;
+        fclose(file);
+        file = nullptr;
+#ifdef _WIN32
+        remove(name.c_str());
+#endif
+        rename((name + ".tmp").c_str(), name.c_str());
+    }
+
+    std::string name;
+    FILE*       file;
+    const char* histogram = nullptr;
+    uint64_t    count     = 0;
+    double      sum       = 0;
+};
+
+
+static void appendBinary(std::string& buffer, const void* data, size_t size) {
+    buffer.append(static_cast<const char*>(data), size);
+}
+
+static void appendBinaryString(std::string& buffer, const std::string& str) {
+    uint32_t size = static_cast<uint32_t>(str.size());
+    appendBinary(buffer, &size, sizeof(size));
+    buffer.append(str);
+}
+
+// append a tagged site entry, the fields are visited in the order of names
+static const std::vector<std::string>& appendBinarySite(
+    std::string& buffer, std::vector<std::vector<std::string>>& site_names, const LogInfo* info,
+    uint64_t offset) {
+    uint32_t id = static_cast<uint32_t>(site_names.size());
+    site_names.emplace_back();
+    for (auto& pair : info->names) site_names.back().push_back(pair.first);
+
+    uint32_t              tag = detail::BINARY_LOG_SITE;
+    detail::BinaryLogSite site{};
+    site.site     = id;
+    site.line     = info->line;
+    site.severity = info->severity;
+    site.event    = info->event;
+    site.offset   = offset;
+    site.fields   = static_cast<uint32_t>(info->names.size());
+    appendBinary(buffer, &tag, sizeof(tag));
+    appendBinary(buffer, &site, sizeof(site));
+    appendBinaryString(buffer, info->filename);
+    appendBinaryString(buffer, info->function);
+    appendBinaryString(buffer, info->message);
+    appendBinaryString(buffer, info->category);
+    for (auto& name : site_names.back()) appendBinaryString(buffer, name);
+    return site_names.back();
+}
+
+// Write the messages in the binary log format described in logfile.h. Each
+// record stores the printed fields only, the meta data of the log site goes to the
+// index file once, together with an offset and time range entry every `interval`
+// flushed blocks, so LogFileReader can seek without scanning the records.
+class BinaryLogger : public Logger {
+public:
+    BinaryLogger(std::string name, unsigned interval) : interval(interval ? interval : 1) {
+        file  = fopen(name.c_str(), "wb");
+        index = fopen((name + ".idx").c_str(), "wb");
+        if (!file || !index) return;
+
+        uint64_t version = detail::BinaryLogVersion;
+        fwrite("ZEROERRB", 8, 1, file);
+        fwrite(&version, sizeof(version), 1, file);
+        fwrite("ZEROERRI", 8, 1, index);
+        offset = block.begin = 16;
+    }
+    ~BinaryLogger() {
+        writeBlockIndex();
+        if (file) fclose(file);
+        if (index) fclose(index);
+    }
+
+    void flush(DataBlock* msg) override {
+        if (!file || !index) return;
+        records.clear();
+        for (auto p = msg->begin(); p < msg->end(); p = moveBytes(p, p->info->size)) {
+            const std::vector<std::string>& names = getSite(p->info);
+
+            detail::BinaryLogRecord header{};
+            header.site   = site_ids[p->info];
+            header.time   = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                              p->time.time_since_epoch())
+                              .count();
+            header.thread = p->thread;
+            header.fields = static_cast<uint32_t>(names.size());
+
+            size_t start = records.size();
+            appendBinary(records, &header, sizeof(header));
+            fields.count = 0;
+            p->visit(fields);
+            // a name without a field is stored as an empty field
+            for (; fields.count < names.size(); fields.count++) appendBinaryString(records, "");
+            records.resize((records.size() + 7) & ~size_t(7), '\0');
+
+            uint32_t size = static_cast<uint32_t>(records.size() - start);
+            memcpy(&records[start], &size, sizeof(size));
+
+            if (header.time < block.min_time) block.min_time = header.time;
+            if (header.time > block.max_time) block.max_time = header.time;
+        }
+        if (records.empty()) return;
+
+        fwrite(records.data(), records.size(), 1, file);
+        fflush(file);
+        offset += records.size();
+
+        // the index entries are written after the records they refer to
+        if (!sites.empty()) {
+            fwrite(sites.data(), sites.size(), 1, index);
+            sites.clear();
+        }
+        if (++blocks >= interval) writeBlockIndex();
+        fflush(index);
+    }
+
+protected:
+    const std::vector<std::string>& getSite(const LogInfo* info) {
+        auto it = site_ids.find(info);
+        if (it != site_ids.end()) return site_names[it->second];
+
+        site_ids[info] = static_cast<uint32_t>(site_names.size());
+        return appendBinarySite(sites, site_names, info, offset + records.size());
+    }
+
+    // append the fields with their length, strings are stored without quotes
+    struct FieldWriter : FieldVisitor {
+        std::string& out;
+        unsigned     count = 0;
+
+        FieldWriter(std::string& out) : out(out) {}
+        void visit(const std::string&, const LogField& field) override {
+            size_t start = out.size();
+            out.append(sizeof(uint32_t), '\0');
+            if (field.type == STRING_f)
+                out.append(static_cast<const char*>(field.value), field.size);
+            else
+                field.append(out);
+            uint32_t size = static_cast<uint32_t>(out.size() - start - sizeof(uint32_t));
+            memcpy(&out[start], &size, sizeof(size));
+            count++;
+        }
+    };
+
+    void writeBlockIndex() {
+        if (!index || offset == block.begin) return;
+        uint32_t tag = detail::BINARY_LOG_BLOCK;
+        block.end    = offset;
+        fwrite(&tag, sizeof(tag), 1, index);
+        fwrite(&block, sizeof(block), 1, index);
+        fflush(index);
+
+        block.begin    = offset;
+        block.min_time = INT64_MAX;
+        block.max_time = INT64_MIN;
+        blocks         = 0;
+    }
+
+    FILE*                                          file;
+    FILE*                                          index;
+    unsigned                                       interval;
+    unsigned                                       blocks = 0;
+    uint64_t                                       offset = 0;
+    detail::BinaryLogBlock                         block{0, 0, INT64_MAX, INT64_MIN};
+    std::unordered_map<const LogInfo*, uint32_t>   site_ids;
+    std::vector<std::vector<std::string>>          site_names;
+    std::string                                    records, sites;
+    FieldWriter                                    fields{records};
+};
+
+
+#ifndef _WIN32
+// Write the messages into a shared memory ring described in logfile.h, which is read
+// by LogRingReader in another process. The fields keep their binary values, so the
+// producer only copies bytes and the consumer does the formatting.
+class SharedMemoryLogger : public Logger {
+public:
+    SharedMemoryLogger(std::string name, size_t size) {
+        if (name.empty() || name[0] != '/') name = "/" + name;
+        this->name = name;
+
+        // a ring of the same name may still be mapped by a reader: it is unlinked instead of
+        // truncated, so the old mappings stay valid and a new object is created
+        shm_unlink(name.c_str());
+        int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+        if (fd == -1) return;
+        struct stat info;
+        if (fstat(fd, &info) == 0) inode = info.st_ino;
+        size = (size + 7) & ~size_t(7);
+        if (size < 4096) size = 4096;
+        total = sizeof(detail::LogRingHeader) + size / 8 + size;
+        if (ftruncate(fd, static_cast<off_t>(total)) == 0) {
+            void* p = mmap(nullptr, total, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            if (p != MAP_FAILED) header = static_cast<detail::LogRingHeader*>(p);
+        }
+        close(fd);
+        if (!header) return;
+
+        new (header) detail::LogRingHeader();
+        memcpy(header->magic, "ZEROERRS", 8);
+        header->version   = detail::LogRingVersion;
+        header->pid       = static_cast<uint64_t>(getpid());
+        header->site_size = size / 8;
+        header->ring_size = size;
+        site_area         = reinterpret_cast<char*>(header + 1);
+        ring_area         = site_area + header->site_size;
+    }
+    ~SharedMemoryLogger() {
+        if (!header) return;
+        munmap(header, total);
+        // the name is only removed if another producer has not replaced the ring
+        int fd = shm_open(name.c_str(), O_RDONLY, 0);
+        if (fd == -1) return;
+        struct stat info;
+        if (fstat(fd, &info) == 0 && info.st_ino == inode) shm_unlink(name.c_str());
+        close(fd);
+    }
+
+    void flush(DataBlock* msg) override {
+        if (!header) return;
+        uint64_t head = header->head.load(std::memory_order_relaxed);
+        for (auto p = msg->begin(); p < msg->end(); p = moveBytes(p, p->info->size)) {
+            auto it = site_ids.find(p->info);
+            if (it == site_ids.end() && !addSite(p->info)) {
+                header->dropped.fetch_add(1, std::memory_order_relaxed);
+                continue;
+            }
+            uint32_t site = site_ids[p->info];
+
+            detail::BinaryLogRecord record{};
+            record.site   = site;
+            record.time   = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                              p->time.time_since_epoch())
+                              .count();
+            record.thread = p->thread;
+            record.fields = static_cast<uint32_t>(site_names[site].size());
+
+            buffer.clear();
+            appendBinary(buffer, &record, sizeof(record));
+            fields.count = 0;
+            p->visit(fields);
+            for (; fields.count < record.fields; fields.count++) fields.append(STRING_f, "", 0);
+            buffer.resize((buffer.size() + 7) & ~size_t(7), '\0');
+            uint32_t size = static_cast<uint32_t>(buffer.size());
+            memcpy(&buffer[0], &size, sizeof(size));
+
+            if (!reserve(head, size)) {
+                header->dropped.fetch_add(1, std::memory_order_relaxed);
+                continue;
+            }
+            memcpy(ring_area + head % header->ring_size, buffer.data(), size);
+            head += size;
+        }
+        header->head.store(head, std::memory_order_release);
+    }
+
+protected:
+    // the site entries are published before the records using them
+    bool addSite(const LogInfo* info) {
+        std::string entry;
+        appendBinarySite(entry, site_names, info, 0);
+        if (site_used + entry.size() > header->site_size) {
+            site_names.pop_back();
+            return false;
+        }
+        memcpy(site_area + site_used, entry.data(), entry.size());
+        site_used += entry.size();
+        header->site_used.store(site_used, std::memory_order_release);
+        site_ids[info] = static_cast<uint32_t>(site_names.size() - 1);
+        return true;
+    }
+
+    // make room for a record at head, a padding record fills the end of the ring if the
+    // record does not fit there
+    bool reserve(uint64_t& head, uint32_t size) {
+        uint64_t ring = header->ring_size;
+        uint64_t tail = header->tail.load(std::memory_order_acquire);
+        uint64_t left = ring - head % ring;
+        uint64_t need = size <= left ? size : left + size;
+        if (head + need - tail > ring) return false;
+        if (size > left) {
+            // only size and site are written, at least 8 bytes are left at the end
+            uint32_t padding[2] = {static_cast<uint32_t>(left), detail::LogRingPadding};
+            memcpy(ring_area + head % ring, padding, sizeof(padding));
+            head += left;
+        }
+        return true;
+    }
+
+    // append the fields with their type and length, the values are kept in binary
+    struct FieldWriter : FieldVisitor {
+        std::string& out;
+        unsigned     count = 0;
+
+        FieldWriter(std::string& out) : out(out) {}
+        void append(FieldType type, const void* value, size_t size) {
+            uint8_t  t = static_cast<uint8_t>(type);
+            uint32_t n = static_cast<uint32_t>(size);
+            appendBinary(out, &t, sizeof(t));
+            appendBinary(out, &n, sizeof(n));
+            appendBinary(out, value, size);
+        }
+        void visit(const std::string&, const LogField& field) override {
+            count++;
+            switch (field.type) {
+                case INT_f: {
+                    int64_t v = *static_cast<const int64_t*>(field.value);
+                    return append(INT_f, &v, sizeof(v));
+                }
+                case UINT_f: {
+                    uint64_t v = *static_cast<const uint64_t*>(field.value);
+                    return append(UINT_f, &v, sizeof(v));
+                }
+                case FLOAT_f: {
+                    double v = *static_cast<const double*>(field.value);
+                    return append(FLOAT_f, &v, sizeof(v));
+                }
+                case BOOL_f: {
+                    uint8_t v = *static_cast<const bool*>(field.value);
+                    return append(BOOL_f, &v, sizeof(v));
+                }
+                case STRING_f: return append(STRING_f, field.value, field.size);
+                default: {
+                    std::string text = field.str();
+                    return append(OTHER_f, text.data(), text.size());
+                }
+            }
+        }
+    };
+
+    std::string                                  name;
+    ino_t                                        inode     = 0;
+    size_t                                       total     = 0;
+    detail::LogRingHeader*                       header    = nullptr;
+    char*                                        site_area = nullptr;
+    char*                                        ring_area = nullptr;
+    uint64_t                                     site_used = 0;
+    std::unordered_map<const LogInfo*, uint32_t> site_ids;
+    std::vector<std::vector<std::string>>        site_names;
+    std::string                                  buffer;
+    FieldWriter                                  fields{buffer};
+};
+#endif
+
+
+static thread_local LogStream* captured_stream = nullptr;
+
 LogStream& LogStream::getDefault() {
+    if (captured_stream) return *captured_stream;
     static LogStream stream;
     return stream;
 }
 
+LogCaptureScope::LogCaptureScope()
+    : owned(new LogStream()), m_stream(owned.get()), previous(captured_stream) {
+    m_stream->setFlushManually();
+    captured_stream = m_stream;
+}
+
+LogCaptureScope::LogCaptureScope(LogStream& stream)
+    : m_stream(&stream), previous(captured_stream) {
+    captured_stream = m_stream;
+}
+
+LogCaptureScope::~LogCaptureScope() { captured_stream = previous; }
+
 void LogStream::setFileLogger(std::string name, DirMode mode1, DirMode mode2, DirMode mode3) {
     if (logger) delete logger;
 
@@ -391,6 +1094,32 @@ void LogStream::setFileLogger(std::string name, DirMode mode1, DirMode mode2, Di
     }
 }
 
+void LogStream::setTraceLogger(std::string name) {
+    if (logger) delete logger;
+    logger = new ChromeTraceLogger(name);
+}
+
+void LogStream::setMetricsLogger(std::string name) {
+    if (logger) delete logger;
+    logger = new MetricsLogger(name);
+}
+
+void LogStream::setBinaryLogger(std::string name, unsigned index_interval) {
+    if (logger) delete logger;
+    logger = new BinaryLogger(name, index_interval);
+}
+
+void LogStream::setSharedMemoryLogger(std::string name, size_t size) {
+#ifdef _WIN32
+    (void)name;
+    (void)size;
+    throw std::runtime_error("shared memory log ring is not supported on Windows");
+#else
+    if (logger) delete logger;
+    logger = new SharedMemoryLogger(name, size);
+#endif
+}
+
 void LogStream::setStdoutLogger() {
     if (logger) delete logger;
     logger = new OStreamLogger(std::cout);
@@ -440,32 +1169,39 @@ void resumeLog() {
 }
 
 #define zeroerr_color(x) (colorful ? x : "")
-static std::string DefaultLogCallback(const LogMessage& msg, bool colorful) {
-    std::stringstream ss;
-    std::time_t       t  = std::chrono::system_clock::to_time_t(msg.time);
-    std::tm           tm = *std::localtime(&t);
+static void DefaultLogCallback(const LogMessage& msg, bool colorful, std::string& out) {
+    // the time is rendered once per second for each thread
+    static thread_local std::time_t last_time = -1;
+    static thread_local char        time_text[32];
+    std::time_t                     t = std::chrono::system_clock::to_time_t(msg.time);
+    if (t != last_time) {
+        std::tm tm = *std::localtime(&t);
+        std::strftime(time_text, sizeof(time_text), "%Y-%m-%d %H:%M:%S", &tm);
+        last_time = t;
+    }
 
-    ss << zeroerr_color(Dim) << '[' << zeroerr_color(Reset);
+    out += zeroerr_color(Dim);
+    out += '[';
+    out += zeroerr_color(Reset);
     switch (msg.info->severity) {
-        case INFO_l:  ss << "INFO "; break;
-        case LOG_l:   ss << zeroerr_color(FgGreen) << "LOG  " << zeroerr_color(Reset); break;
-        case WARN_l:  ss << zeroerr_color(FgYellow) << "WARN " << zeroerr_color(Reset); break;
-        case ERROR_l: ss << zeroerr_color(FgRed) << "ERROR" << zeroerr_color(Reset); break;
-        case FATAL_l: ss << zeroerr_color(FgMagenta) << "FATAL" << zeroerr_color(Reset); break;
+        case INFO_l:  out += "INFO "; break;
+        case LOG_l:   out += zeroerr_color(FgGreen); out += "LOG  "; out += zeroerr_color(Reset); break;
+        case WARN_l:  out += zeroerr_color(FgYellow); out += "WARN "; out += zeroerr_color(Reset); break;
+        case ERROR_l: out += zeroerr_color(FgRed); out += "ERROR"; out += zeroerr_color(Reset); break;
+        case FATAL_l: out += zeroerr_color(FgMagenta); out += "FATAL"; out += zeroerr_color(Reset); break;
     }
-    ss << " " << std::put_time(&tm, "%Y-%m-%d %H:%M:%S");
-
-    std::string fileName(msg.info->filename);
-
-    auto p = fileName.find_last_of('/');
-    if (p != std::string::npos) fileName = fileName.substr(p + 1);
-    auto q = fileName.find_last_of('\\');
-    if (q != std::string::npos) fileName = fileName.substr(q + 1);
-
-    ss << " " << fileName << ":" << msg.info->line;
-    ss << zeroerr_color(Dim) << ']' << zeroerr_color(Reset) << "  " << msg.str();
-    ss << std::endl;
-    return ss.str();
+    out += ' ';
+    out += time_text;
+    out += ' ';
+    out += msg.info->short_filename;
+    out += ':';
+    detail::format_uint(out, msg.info->line);
+    out += zeroerr_color(Dim);
+    out += ']';
+    out += zeroerr_color(Reset);
+    out += "  ";
+    msg.str(out);
+    out += '\n';
 }
 #undef zeroerr_color
 
@@ -0,0 +1,445 @@
+#include "zeroerr/logfile.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace zeroerr {
+
+std::chrono::system_clock::time_point LogFileRecord::time() const {
+    return std::chrono::system_clock::time_point(
+        std::chrono::duration_cast<std::chrono::system_clock::duration>(
+            std::chrono::nanoseconds(header()->time)));
+}
+
+const LogFileRecord::Site& LogFileRecord::site() const { return reader->m_sites[header()->site]; }
+
+LogFileString LogFileRecord::field(unsigned index) const {
+    LogFileString result;
+    if (index >= fields()) return result;
+
+    const char* q = p + sizeof(detail::BinaryLogRecord);
+    for (unsigned i = 0;; ++i) {
+        uint32_t size;
+        memcpy(&size, q, sizeof(size));
+        if (i == index) {
+            result.data = q + sizeof(size);
+            result.size = size;
+            return result;
+        }
+        q += sizeof(size) + size;
+    }
+}
+
+LogFileString LogFileRecord::get(const std::string& name) const {
+    auto& names = site().names;
+    for (unsigned i = 0; i < names.size(); ++i)
+        if (names[i] == name) return field(i);
+    return LogFileString();
+}
+
+std::string LogFileRecord::str() const {
+    std::string result;
+    auto&       names = site().names;
+    for (const char* s = site().message.c_str(); *s; ++s) {
+        const char* e = *s == '{' ? strchr(s, '}') : nullptr;
+        if (!e) {
+            result.push_back(*s);
+            continue;
+        }
+        std::string name(s + 1, e);
+        auto        it = std::find(names.begin(), names.end(), name);
+        if (it != names.end()) {
+            LogFileString value = field(static_cast<unsigned>(it - names.begin()));
+            result.append(value.data, value.size);
+        }
+        s = e;
+    }
+    return result;
+}
+
+
+LogFileIterator& LogFileIterator::operator++() {
+    do {
+        next();
+    } while (record.p && !check_filter());
+    return *this;
+}
+
+bool LogFileIterator::check_filter() const {
+    auto header = record.header();
+    if (header->site >= record.reader->sites().size()) return false;
+    if (!sites.empty() && !sites[header->site]) return false;
+    return min_time <= header->time && header->time < max_time;
+}
+
+void LogFileIterator::next() {
+    record.p += record.header()->size;
+    check_end();
+}
+
+void LogFileIterator::check_end() {
+    // stop at the end of the range or at a record cut by a crash
+    if (record.p + sizeof(detail::BinaryLogRecord) > stop ||
+        record.header()->size < sizeof(detail::BinaryLogRecord) ||
+        record.p + record.header()->size > stop)
+        record.p = nullptr;
+}
+
+
+LogFileReader::LogFileReader(std::string name) {
+#ifdef _WIN32
+    file = CreateFileA(name.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+                       OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) throw std::runtime_error("LogFileReader: cannot open " + name);
+    LARGE_INTEGER file_size;
+    GetFileSizeEx(file, &file_size);
+    size = static_cast<size_t>(file_size.QuadPart);
+    if (size > 0) {
+        mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (mapping) data = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    }
+#else
+    fd = open(name.c_str(), O_RDONLY);
+    if (fd == -1) throw std::runtime_error("LogFileReader: cannot open " + name);
+    struct stat st;
+    fstat(fd, &st);
+    size = static_cast<size_t>(st.st_size);
+    if (size > 0) {
+        void* p = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+        if (p != MAP_FAILED) data = static_cast<const char*>(p);
+    }
+#endif
+    if (!data || size < 16 || memcmp(data, "ZEROERRB", 8) != 0) {
+        close();
+        throw std::runtime_error("LogFileReader: " + name + " is not a binary log file");
+    }
+    load_index(name + ".idx");
+    scan_tail();
+
+    prefix_max.resize(blocks.size());
+    suffix_min.resize(blocks.size());
+    for (size_t i = 0; i < blocks.size(); ++i)
+        prefix_max[i] = std::max(blocks[i].max_time, i ? prefix_max[i - 1] : INT64_MIN);
+    for (size_t i = blocks.size(); i-- > 0;)
+        suffix_min[i] =
+            std::min(blocks[i].min_time, i + 1 < blocks.size() ? suffix_min[i + 1] : INT64_MAX);
+}
+
+LogFileReader::~LogFileReader() { close(); }
+
+void LogFileReader::close() {
+#ifdef _WIN32
+    if (data) UnmapViewOfFile(data);
+    if (mapping) CloseHandle(mapping);
+    if (file && file != INVALID_HANDLE_VALUE) CloseHandle(file);
+    data = nullptr, mapping = file = nullptr;
+#else
+    if (data) munmap(const_cast<char*>(data), size);
+    if (fd != -1) ::close(fd);
+    data = nullptr, fd = -1;
+#endif
+}
+
+static bool readIndex(const char* buffer, size_t end, size_t& pos, void* out, size_t size) {
+    if (pos + size > end) return false;
+    memcpy(out, buffer + pos, size);
+    pos += size;
+    return true;
+}
+
+static bool readIndexString(const char* buffer, size_t end, size_t& pos, std::string& out) {
+    uint32_t size;
+    if (!readIndex(buffer, end, pos, &size, sizeof(size)) || pos + size > end) return false;
+    out.assign(buffer + pos, size);
+    pos += size;
+    return true;
+}
+
+// read a site entry after its tag, false is returned if the entry is incomplete
+static bool readIndexSite(const char* buffer, size_t end, size_t& pos, uint32_t& id,
+                          LogFileRecord::Site& site) {
+    detail::BinaryLogSite entry;
+    if (!readIndex(buffer, end, pos, &entry, sizeof(entry))) return false;
+    if (!readIndexString(buffer, end, pos, site.filename) ||
+        !readIndexString(buffer, end, pos, site.function) ||
+        !readIndexString(buffer, end, pos, site.message) ||
+        !readIndexString(buffer, end, pos, site.category))
+        return false;
+    site.names.resize(entry.fields);
+    for (auto& n : site.names)
+        if (!readIndexString(buffer, end, pos, n)) return false;
+    id            = entry.site;
+    site.line     = entry.line;
+    site.severity = static_cast<LogSeverity>(entry.severity);
+    site.event    = static_cast<LogEvent>(entry.event);
+    site.offset   = entry.offset;
+    return true;
+}
+
+void LogFileReader::load_index(const std::string& name) {
+    std::string buffer;
+    FILE*       index = fopen(name.c_str(), "rb");
+    if (index) {
+        char chunk[4096];
+        for (size_t n; (n = fread(chunk, 1, sizeof(chunk), index)) > 0;) buffer.append(chunk, n);
+        fclose(index);
+    }
+    if (buffer.compare(0, 8, "ZEROERRI") != 0) return;
+
+    // an entry cut by a crash is ignored
+    const char* p = buffer.data();
+    for (size_t pos = 8, end = buffer.size(); pos < end;) {
+        uint32_t tag;
+        if (!readIndex(p, end, pos, &tag, sizeof(tag))) break;
+        if (tag == detail::BINARY_LOG_BLOCK) {
+            detail::BinaryLogBlock block;
+            if (!readIndex(p, end, pos, &block, sizeof(block)) || block.end > size) break;
+            blocks.push_back(block);
+        } else if (tag == detail::BINARY_LOG_SITE) {
+            uint32_t            id;
+            LogFileRecord::Site site;
+            if (!readIndexSite(p, end, pos, id, site) || id != m_sites.size()) break;
+            m_sites.push_back(site);
+        } else {
+            break;
+        }
+    }
+}
+
+// The records after the last block entry are not indexed when the writer did not
+// exit normally. They are at most a few blocks, scan them as an extra block entry.
+void LogFileReader::scan_tail() {
+    detail::BinaryLogBlock tail{blocks.empty() ? 16 : blocks.back().end, 0, INT64_MAX, INT64_MIN};
+    size_t                 pos = tail.begin;
+    while (pos + sizeof(detail::BinaryLogRecord) <= size) {
+        detail::BinaryLogRecord header;
+        memcpy(&header, data + pos, sizeof(header));
+        if (header.size < sizeof(header) || pos + header.size > size) break;
+        tail.min_time = std::min(tail.min_time, header.time);
+        tail.max_time = std::max(tail.max_time, header.time);
+        pos += header.size;
+    }
+    tail.end = pos;
+    if (tail.end > tail.begin) blocks.push_back(tail);
+}
+
+LogFileIterator LogFileReader::begin(std::string message, std::string function_name,
+                                     int line) const {
+    LogFileIterator iter;
+    iter.sites.resize(m_sites.size());
+
+    uint64_t start = UINT64_MAX;
+    for (size_t i = 0; i < m_sites.size(); ++i) {
+        auto& site = m_sites[i];
+        if (!message.empty() && site.message.compare(0, message.size(), message) != 0) continue;
+        if (!function_name.empty() && site.function != function_name) continue;
+        if (line != -1 && site.line != static_cast<unsigned>(line)) continue;
+        iter.sites[i] = true;
+        start         = std::min(start, site.offset);
+    }
+    if (start == UINT64_MAX || blocks.empty()) return end();
+
+    iter.record.reader = this;
+    iter.record.p      = data + start;
+    iter.stop          = data + blocks.back().end;
+    iter.check_end();
+    if (iter.record.p && !iter.check_filter()) ++iter;
+    return iter;
+}
+
+LogFileIterator LogFileReader::begin(std::chrono::system_clock::time_point from,
+                                     std::chrono::system_clock::time_point to) const {
+    LogFileIterator iter;
+    iter.min_time =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(from.time_since_epoch()).count();
+    iter.max_time =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(to.time_since_epoch()).count();
+
+    // the first block which may contain a record at or after `from`, and the first
+    // block from which all records are at or after `to`
+    auto first = std::lower_bound(prefix_max.begin(), prefix_max.end(), iter.min_time);
+    auto last  = std::lower_bound(suffix_min.begin(), suffix_min.end(), iter.max_time);
+    if (first == prefix_max.end() || first >= last) return end();
+
+    iter.record.reader = this;
+    iter.record.p      = data + blocks[first - prefix_max.begin()].begin;
+    iter.stop          = data + blocks[last - suffix_min.begin() - 1].end;
+    iter.check_end();
+    if (iter.record.p && !iter.check_filter()) ++iter;
+    return iter;
+}
+
+
+std::chrono::system_clock::time_point LogRingRecord::time() const {
+    return std::chrono::system_clock::time_point(
+        std::chrono::duration_cast<std::chrono::system_clock::duration>(
+            std::chrono::nanoseconds(header()->time)));
+}
+
+const LogFileRecord::Site& LogRingRecord::site() const { return reader->m_sites[header()->site]; }
+
+unsigned LogRingRecord::pid() const { return reader->pid(); }
+
+const char* LogRingRecord::find(unsigned index, uint8_t& type, uint32_t& size) const {
+    const char* q = p + sizeof(detail::BinaryLogRecord);
+    for (unsigned i = 0; i <= index; ++i) {
+        type = static_cast<uint8_t>(*q);
+        memcpy(&size, q + 1, sizeof(size));
+        q += 1 + sizeof(size);
+        if (i == index) break;
+        q += size;
+    }
+    return q;
+}
+
+FieldType LogRingRecord::type(unsigned index) const {
+    if (index >= fields()) return OTHER_f;
+    uint8_t  type;
+    uint32_t size;
+    find(index, type, size);
+    return static_cast<FieldType>(type);
+}
+
+std::string LogRingRecord::field(unsigned index) const {
+    if (index >= fields()) return std::string();
+    uint8_t     type;
+    uint32_t    size;
+    const char* q = find(index, type, size);
+
+    char buf[32];
+    switch (type) {
+        case INT_f: {
+            int64_t v;
+            memcpy(&v, q, sizeof(v));
+            snprintf(buf, sizeof(buf), "%lld", static_cast<long long>(v));
+            return buf;
+        }
+        case UINT_f: {
+            uint64_t v;
+            memcpy(&v, q, sizeof(v));
+            snprintf(buf, sizeof(buf), "%llu", static_cast<unsigned long long>(v));
+            return buf;
+        }
+        case FLOAT_f: {
+            double v;
+            memcpy(&v, q, sizeof(v));
+            snprintf(buf, sizeof(buf), "%g", v);
+            return buf;
+        }
+        case BOOL_f: return *q ? "true" : "false";
+        default: return std::string(q, size);
+    }
+}
+
+std::string LogRingRecord::get(const std::string& name) const {
+    auto& names = site().names;
+    for (unsigned i = 0; i < names.size(); ++i)
+        if (names[i] == name) return field(i);
+    return std::string();
+}
+
+std::string LogRingRecord::str() const {
+    std::string result;
+    auto&       names = site().names;
+    for (const char* s = site().message.c_str(); *s; ++s) {
+        const char* e = *s == '{' ? strchr(s, '}') : nullptr;
+        if (!e) {
+            result.push_back(*s);
+            continue;
+        }
+        auto it = std::find(names.begin(), names.end(), std::string(s + 1, e));
+        if (it != names.end()) result += field(static_cast<unsigned>(it - names.begin()));
+        s = e;
+    }
+    return result;
+}
+
+
+LogRingReader::LogRingReader(std::string name) : m_name(name) {
+#ifdef _WIN32
+    throw std::runtime_error("LogRingReader: shared memory log ring is not supported on Windows");
+#else
+    if (name.empty() || name[0] != '/') name = "/" + name;
+    int fd = shm_open(name.c_str(), O_RDWR, 0);
+    if (fd == -1) throw std::runtime_error("LogRingReader: cannot open " + name);
+    struct stat st;
+    fstat(fd, &st);
+    size    = static_cast<size_t>(st.st_size);
+    void* p = size >= sizeof(detail::LogRingHeader)
+                  ? mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)
+                  : MAP_FAILED;
+    ::close(fd);
+    if (p == MAP_FAILED) throw std::runtime_error("LogRingReader: cannot map " + name);
+
+    header = static_cast<detail::LogRingHeader*>(p);
+    if (memcmp(header->magic, "ZEROERRS", 8) != 0 ||
+        sizeof(detail::LogRingHeader) + header->site_size + header->ring_size > size) {
+        munmap(p, size);
+        throw std::runtime_error("LogRingReader: " + name + " is not a log ring");
+    }
+    site_area = static_cast<const char*>(p) + sizeof(detail::LogRingHeader);
+    ring_area = site_area + header->site_size;
+#endif
+}
+
+LogRingReader::~LogRingReader() {
+#ifndef _WIN32
+    if (header) munmap(header, size);
+#endif
+}
+
+void LogRingReader::load_sites() {
+    size_t end = header->site_used.load(std::memory_order_acquire);
+    for (size_t pos = site_read; pos < end;) {
+        uint32_t            tag, id;
+        LogFileRecord::Site site;
+        if (!readIndex(site_area, end, pos, &tag, sizeof(tag)) || tag != detail::BINARY_LOG_SITE ||
+            !readIndexSite(site_area, end, pos, id, site))
+            break;
+        m_sites.push_back(site);
+        site_read = pos;
+    }
+}
+
+LogRingRecord LogRingReader::peek() {
+    LogRingRecord record;
+    uint64_t      tail = header->tail.load(std::memory_order_relaxed);
+    uint64_t      head = header->head.load(std::memory_order_acquire);
+    while (tail != head) {
+        auto* p = reinterpret_cast<const detail::BinaryLogRecord*>(ring_area +
+                                                                   tail % header->ring_size);
+        if (p->site != detail::LogRingPadding) {
+            // sites are published before the records using them
+            if (p->site >= m_sites.size()) load_sites();
+            if (p->site < m_sites.size()) {
+                record.reader = this;
+                record.p      = reinterpret_cast<const char*>(p);
+                current       = p->size;
+                return record;
+            }
+        }
+        tail += p->size;
+        header->tail.store(tail, std::memory_order_release);
+    }
+    return record;
+}
+
+void LogRingReader::pop() {
+    if (current == 0) return;
+    header->tail.store(header->tail.load(std::memory_order_relaxed) + current,
+                       std::memory_order_release);
+    current = 0;
+}
+
+}  // namespace zeroerr
@@ -0,0 +1,212 @@
+#include "zeroerr/metric.h"
+#include "zeroerr/internal/threadsafe.h"
+
+#include <map>
+#include <vector>
+
+#ifndef ZEROERR_NO_THREAD_SAFE
+#include <condition_variable>
+#include <thread>
+#endif
+
+namespace zeroerr {
+
+static Metric* metric_list = nullptr;
+ZEROERR_MUTEX(metric_mutex);
+
+static unsigned metric_record_size(MetricType type) {
+    switch (type) {
+        case COUNTER_m: return sizeof(LogMessageImpl<int64_t>);
+        case GAUGE_m: return sizeof(LogMessageImpl<double>);
+        case HISTOGRAM_m: return sizeof(LogMessageImpl<uint64_t, double>);
+    }
+    return 0;
+}
+
+static LogEvent metric_record_event(MetricType type) {
+    switch (type) {
+        case COUNTER_m: return METRIC_COUNTER_e;
+        case GAUGE_m: return METRIC_GAUGE_e;
+        case HISTOGRAM_m: return METRIC_HISTOGRAM_e;
+    }
+    return INSTANT_e;
+}
+
+Metric::Metric(const char* filename, const char* function, const char* name,
+               const char* category, unsigned line, MetricType type)
+    : info(filename, function, name, category, line, metric_record_size(type), INFO_l,
+           metric_record_event(type)),
+      type(type),
+      gauge(0) {
+    if (type == HISTOGRAM_m) {
+        histogram          = new ZEROERR_ATOMIC(uint64_t)[shards][buckets]();
+        info.names["count"] = 0;
+        info.names["sum"]   = 1;
+    } else {
+        info.names["value"] = 0;
+    }
+
+    ZEROERR_LOCK(metric_mutex);
+    next        = metric_list;
+    metric_list = this;
+}
+
+Metric::~Metric() {
+    {
+        ZEROERR_LOCK(metric_mutex);
+        for (Metric** p = &metric_list; *p; p = &(*p)->next)
+            if (*p == this) {
+                *p = next;
+                break;
+            }
+    }
+    delete[] histogram;
+}
+
+int64_t Metric::counter_value() const {
+    int64_t sum = 0;
+    for (auto& s : data) sum += ZEROERR_LOAD(s.count);
+    return sum;
+}
+
+double Metric::gauge_value() const { return ZEROERR_LOAD(gauge); }
+
+uint64_t Metric::histogram_count() const { return static_cast<uint64_t>(counter_value()); }
+
+double Metric::histogram_sum() const {
+    double sum = 0;
+    for (auto& s : data) sum += ZEROERR_LOAD(s.sum);
+    return sum;
+}
+
+uint64_t Metric::histogram_bucket(unsigned index) const {
+    if (!histogram || index >= buckets) return 0;
+    uint64_t sum = 0;
+    for (unsigned i = 0; i < shards; ++i) sum += ZEROERR_LOAD(histogram[i][index]);
+    return sum;
+}
+
+
+void writeMetrics(LogStream& stream) {
+    static LogInfo begin_info{__FILE__,
+                              __func__,
+                              "metrics snapshot",
+                              ZEROERR_LOG_CATEGORY,
+                              __LINE__,
+                              sizeof(LogMessageImpl<>),
+                              INFO_l,
+                              SCOPE_BEGIN_e};
+    static LogInfo end_info{__FILE__, __func__, "metrics snapshot", ZEROERR_LOG_CATEGORY,
+                            __LINE__, sizeof(LogMessageImpl<>), INFO_l, SCOPE_END_e};
+    static LogInfo bucket_info{__FILE__, __func__, "{le} {count}", ZEROERR_LOG_CATEGORY,
+                               __LINE__, sizeof(LogMessageImpl<double, uint64_t>), INFO_l,
+                               METRIC_BUCKET_e};
+
+    stream.push().log->info = &begin_info;
+
+    {
+        ZEROERR_LOCK(metric_mutex);
+
+        // sites sharing a name are reported as one metric, counters and histograms
+        // are summed up and a gauge reports the value of the latest registered site
+        std::map<std::string, std::vector<const Metric*>> groups;
+        for (const Metric* m = metric_list; m; m = m->next) groups[m->info.message].push_back(m);
+
+        for (auto& group : groups) {
+            const Metric* first = group.second.front();
+            switch (first->type) {
+                case COUNTER_m: {
+                    int64_t value = 0;
+                    for (auto m : group.second) value += m->counter_value();
+                    stream.push(value).log->info = &first->info;
+                    break;
+                }
+                case GAUGE_m: {
+                    stream.push(first->gauge_value()).log->info = &first->info;
+                    break;
+                }
+                case HISTOGRAM_m: {
+                    uint64_t count = 0;
+                    double   sum   = 0;
+                    for (auto m : group.second) {
+                        count += m->histogram_count();
+                        sum += m->histogram_sum();
+                    }
+                    stream.push(count, sum).log->info = &first->info;
+
+                    // only the non-empty buckets are reported, the +Inf bucket is always the last
+                    uint64_t cumulative = 0;
+                    for (unsigned i = 0; i < Metric::buckets; ++i) {
+                        uint64_t n = 0;
+                        for (auto m : group.second) n += m->histogram_bucket(i);
+                        cumulative += n;
+                        if (n == 0 && i != Metric::buckets - 1) continue;
+                        PushResult msg = stream.push(Metric::bucket_upper_bound(i), cumulative);
+                        msg.log->info  = &bucket_info;
+                    }
+                    break;
+                }
+            }
+        }
+    }
+
+    stream.push().log->info = &end_info;
+    if (stream.getFlushMode() == LogStream::FlushMode::FLUSH_AT_ONCE) stream.flush();
+}
+
+
+#ifndef ZEROERR_NO_THREAD_SAFE
+static std::thread*            metrics_exporter = nullptr;
+static std::mutex              metrics_exporter_mutex;
+static std::condition_variable metrics_exporter_cv;
+static bool                    metrics_exporter_stop = false;
+
+void startMetricsExporter(std::string name, double interval) {
+    stopMetricsExporter();
+    metrics_exporter_stop = false;
+    metrics_exporter      = new std::thread([name, interval]() {
+        LogStream stream;
+        stream.setFlushManually();
+        stream.setMetricsLogger(name);
+
+        std::unique_lock<std::mutex> lock(metrics_exporter_mutex);
+        bool                         stop = false;
+        while (!stop) {
+            stop = metrics_exporter_cv.wait_for(lock, std::chrono::duration<double>(interval),
+                                                [] { return metrics_exporter_stop; });
+            writeMetrics(stream);
+            stream.flush();
+        }
+    });
+}
+
+void stopMetricsExporter() {
+    if (!metrics_exporter) return;
+    {
+        std::lock_guard<std::mutex> lock(metrics_exporter_mutex);
+        metrics_exporter_stop = true;
+    }
+    metrics_exporter_cv.notify_all();
+    metrics_exporter->join();
+    delete metrics_exporter;
+    metrics_exporter = nullptr;
+}
+#else
+// Without thread support there is no background thread, the snapshot is
+// written once when the exporter is stopped.
+static std::string metrics_exporter_file;
+
+void startMetricsExporter(std::string name, double) { metrics_exporter_file = name; }
+
+void stopMetricsExporter() {
+    if (metrics_exporter_file.empty()) return;
+    LogStream stream;
+    stream.setFlushManually();
+    stream.setMetricsLogger(metrics_exporter_file);
+    writeMetrics(stream);
+    stream.flush();
+    metrics_exporter_file.clear();
+}
+#endif
+
+}  // namespace zeroerr
@@ -1,8 +1,36 @@
 #include "zeroerr/print.h"
+#include "zeroerr/internal/threadsafe.h"
+
 #include <iostream>
+#include <string>
+#include <typeindex>
+#include <unordered_map>
 
 namespace zeroerr {
 
+namespace detail {
+
+const char* demangleCached(const std::type_info& info) {
+    static thread_local std::unordered_map<std::type_index, const char*> local;
+    auto iter = local.find(info);
+    if (iter != local.end()) return iter->second;
+
+    // never destroyed, the names can be printed by the destructors of static objects
+    static auto* names = new std::unordered_map<std::type_index, std::string>();
+    ZEROERR_MUTEX(mutex)
+    const char* name;
+    {
+        ZEROERR_LOCK(mutex)
+        auto p = names->find(info);
+        if (p == names->end()) p = names->emplace(info, Printer::demangle(info.name())).first;
+        name = p->second.c_str();
+    }
+    local.emplace(info, name);
+    return name;
+}
+
+}  // namespace detail
+
 
 Printer& getStdoutPrinter() {
     static Printer printer(std::cout);
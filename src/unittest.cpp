@@ -4,21 +4,707 @@
 #include "zeroerr/fuzztest.h"
 #include "zeroerr/internal/threadsafe.h"
 #include "zeroerr/log.h"
-
+#include "zeroerr/table.h"
+
+#include <algorithm>
+#include <bitset>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <limits>
+#include <map>
+#include <memory>
 #include <ostream>
 #include <regex>
 #include <set>
+#include <sstream>
 #include <string>
 #include <vector>
 
+#ifndef ZEROERR_NO_THREAD_SAFE
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <thread>
+#endif
+
+#ifdef ZEROERR_OS_UNIX
+#include <poll.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#include <deque>
+#endif
+
+#if defined(ZEROERR_OS_LINUX) && defined(__GLIBC__) && !defined(ZEROERR_NO_THREAD_SAFE)
+#include <execinfo.h>
+#include <sys/syscall.h>
+#define ZEROERR_HAS_BACKTRACE
+#endif
+
+// The exit code of a process stopped by the watchdog, the same as the timeout command
+#define ZEROERR_TIMEOUT_EXIT_CODE 124
+
+// The exit code of a run with bad arguments
+#define ZEROERR_USAGE_EXIT_CODE 2
+
+// With --isolate, the parent kills a child running a test case for this many seconds over
+// its time limit, the smaller of its timeout() decorator and --timeout. With --timeout, the
+// watchdog of the child stops it first and prints the backtraces.
+#ifndef ZEROERR_WATCHDOG_GRACE
+#define ZEROERR_WATCHDOG_GRACE 5
+#endif
+
 namespace zeroerr {
 
+static double timeLimit(const UnitTest& ut, const TestCase& tc);
+
 namespace detail {
-static std::set<TestCase> getRegisteredTests(unsigned type);
+static const std::vector<TestCase>& getRegisteredTests(TestType type);
+
+// The output of a capture kept in memory: the first bytes in the buffer of the report and the
+// last bytes of the rest, which is written to a temporary file
+#ifndef ZEROERR_CAPTURE_HEAD
+#define ZEROERR_CAPTURE_HEAD (1 << 20)
+#endif
+#ifndef ZEROERR_CAPTURE_TAIL
+#define ZEROERR_CAPTURE_TAIL (1 << 16)
+#endif
+
+#ifdef ZEROERR_OS_UNIX
+// create a temporary file, the path is empty if it fails
+static int makeTempFile(std::string& path) {
+    const char*       dir     = std::getenv("TMPDIR");
+    std::string       pattern = std::string(dir && *dir ? dir : "/tmp") + "/zeroerr-XXXXXX";
+    std::vector<char> name(pattern.begin(), pattern.end());
+    name.push_back('\0');
+    int fd = mkstemp(name.data());
+    path   = fd < 0 ? std::string() : std::string(name.data());
+    return fd;
+}
+#endif
+
+/**
+ * @brief CaptureBuf is the buffer of a capture. The first ZEROERR_CAPTURE_HEAD bytes go to the
+ * buffer of the report. The whole output is then written to a temporary file and only its last
+ * ZEROERR_CAPTURE_TAIL bytes are kept, they are added to the report with the path of the file
+ * when the capture finishes. So a test case printing gigabytes does not fill the memory.
+ */
+class CaptureBuf : public std::streambuf {
+public:
+    explicit CaptureBuf(std::stringbuf& report) : report(report) {}
+    ~CaptureBuf() override { finish(); }
+
+    // the bytes in the report, or written to the file descriptor while it is forwarded
+    size_t size() const {
+#ifdef ZEROERR_OS_UNIX
+        if (forward >= 0) {
+            fflush(stdout);
+            off_t offset = lseek(forward, 0, SEEK_CUR);
+            return offset < 0 ? 0 : static_cast<size_t>(offset);
+        }
+#endif
+        return head;
+    }
+
+    // the output captured so far, only the head of a long output
+    std::string str() const {
+#ifdef ZEROERR_OS_UNIX
+        if (forward >= 0) {
+            std::string out(std::min(size(), static_cast<size_t>(ZEROERR_CAPTURE_HEAD)), '\0');
+            ssize_t     n = out.empty() ? 0 : pread(forward, &out[0], out.size(), 0);
+            out.resize(n < 0 ? 0 : static_cast<size_t>(n));
+            return out;
+        }
+#endif
+        return report.str();
+    }
+
+    // write the output to a file descriptor instead, -1 to stop, it keeps the order with printf
+    void forwardTo(int fd) { forward = fd; }
+
+#ifdef ZEROERR_OS_UNIX
+    // Add the output in the file fd at path and close it. A short output is read and the file
+    // is removed, a long one keeps the file as the temporary file holding the whole output and
+    // only its head and last bytes are read, so it is not written a second time.
+    void readFile(int fd, const std::string& file) {
+        off_t  end  = lseek(fd, 0, SEEK_END);
+        size_t size = end < 0 ? 0 : static_cast<size_t>(end);
+        size_t room = ZEROERR_CAPTURE_HEAD - std::min<size_t>(head, ZEROERR_CAPTURE_HEAD);
+        if (omitted != 0 || size <= room) {
+            unlink(file.c_str());
+            std::string all = readAt(fd, 0, size);
+            sputn(all.data(), static_cast<std::streamsize>(all.size()));
+            close(fd);
+            return;
+        }
+        std::string first = readAt(fd, 0, room);
+        report.sputn(first.data(), static_cast<std::streamsize>(first.size()));
+        head += room;
+        omitted = size - room;
+        tail    = readAt(fd, size - std::min<size_t>(omitted, ZEROERR_CAPTURE_TAIL),
+                         std::min<size_t>(omitted, ZEROERR_CAPTURE_TAIL));
+        path    = file;
+        spill   = fdopen(fd, "ab");  // the output written after it is appended
+        if (!spill) close(fd);
+    }
+#endif
+
+    // add the last bytes of the output to the report
+    void finish() {
+        if (omitted == 0) return;
+        size_t      kept = std::min(tail.size(), static_cast<size_t>(ZEROERR_CAPTURE_TAIL));
+        std::string note = "\n... " + std::to_string(omitted - kept) + " bytes omitted";
+        if (!path.empty()) note += ", the whole output is in " + path;
+        note += " ...\n";
+        report.sputn(note.data(), static_cast<std::streamsize>(note.size()));
+        report.sputn(tail.data() + tail.size() - kept, static_cast<std::streamsize>(kept));
+        if (spill) fclose(spill);
+        spill   = nullptr;
+        omitted = 0;
+        tail.clear();
+    }
+
+protected:
+    int_type overflow(int_type c) override {
+        if (traits_type::eq_int_type(c, traits_type::eof())) return traits_type::not_eof(c);
+        char ch = traits_type::to_char_type(c);
+        write(&ch, 1);
+        return c;
+    }
+    std::streamsize xsputn(const char* s, std::streamsize n) override {
+        write(s, static_cast<size_t>(n));
+        return n;
+    }
+
+private:
+#ifdef ZEROERR_OS_UNIX
+    static std::string readAt(int fd, size_t offset, size_t n) {
+        std::string out(n, '\0');
+        size_t      done = 0;
+        for (ssize_t k; done < n; done += static_cast<size_t>(k))
+            if ((k = pread(fd, &out[done], n - done, static_cast<off_t>(offset + done))) <= 0)
+                break;
+        out.resize(done);
+        return out;
+    }
+#endif
+
+    void write(const char* s, size_t n) {
+#ifdef ZEROERR_OS_UNIX
+        if (forward >= 0) {
+            fflush(stdout);
+            for (ssize_t done; n > 0; s += done, n -= static_cast<size_t>(done))
+                if ((done = ::write(forward, s, n)) <= 0) return;
+            return;
+        }
+#endif
+        size_t k = std::min(n, ZEROERR_CAPTURE_HEAD - std::min<size_t>(head, ZEROERR_CAPTURE_HEAD));
+        report.sputn(s, static_cast<std::streamsize>(k));
+        head += k;
+        if (k < n) overflowToFile(s + k, n - k);
+    }
+
+    void overflowToFile(const char* s, size_t n) {
+#ifdef ZEROERR_OS_UNIX
+        if (omitted == 0) {
+            int fd = makeTempFile(path);
+            spill  = fd < 0 ? nullptr : fdopen(fd, "wb");
+            if (spill) {
+                std::string first = report.str();
+                fwrite(first.data(), 1, first.size(), spill);
+            }
+        }
+#endif
+        if (spill) fwrite(s, 1, n, spill);
+        omitted += n;
+        tail.append(s, n);
+        if (tail.size() > 2 * ZEROERR_CAPTURE_TAIL)
+            tail.erase(0, tail.size() - ZEROERR_CAPTURE_TAIL);
+    }
+
+    std::stringbuf& report;
+    size_t          head    = 0;
+    size_t          omitted = 0;  // the bytes after the head
+    std::string     tail;
+    std::string     path;
+    FILE*           spill   = nullptr;
+    int             forward = -1;
+};
+
+// The buffer capturing std::cerr in the current thread, nullptr if it is not captured
+static thread_local CaptureBuf* capture_target = nullptr;
+
+/**
+ * @brief ThreadOutputBuf is installed once as the buffer of std::cerr. It writes to the
+ * capture buffer of the calling thread, or to the original buffer if the thread has none,
+ * so test cases running in different threads capture their own output.
+ */
+class ThreadOutputBuf : public std::streambuf {
+public:
+    explicit ThreadOutputBuf(std::streambuf* orig) : orig(orig) {}
+
+protected:
+    int_type overflow(int_type c) override {
+        if (traits_type::eq_int_type(c, traits_type::eof())) return traits_type::not_eof(c);
+        return out()->sputc(traits_type::to_char_type(c));
+    }
+    std::streamsize xsputn(const char* s, std::streamsize n) override {
+        return out()->sputn(s, n);
+    }
+    int sync() override { return out()->pubsync(); }
+
+private:
+    std::streambuf* out() const {
+        return capture_target ? static_cast<std::streambuf*>(capture_target) : orig;
+    }
+    std::streambuf* orig;
+};
+
+/**
+ * @brief OutputCapture captures std::cerr of the current thread into a buffer while it is
+ * alive. Captures can be nested, the previous buffer is restored at the end.
+ */
+class OutputCapture {
+public:
+    explicit OutputCapture(std::stringbuf& report) : buf(report), previous(capture_target) {
+        static std::streambuf* route = install();
+        (void)route;
+        capture_target = &buf;
+    }
+    ~OutputCapture() {
+        buf.finish();
+        capture_target = previous;
+    }
+
+    OutputCapture(const OutputCapture&)            = delete;
+    OutputCapture& operator=(const OutputCapture&) = delete;
+
+    CaptureBuf& buffer() { return buf; }
+
+private:
+    static std::streambuf* install() {
+        ThreadOutputBuf* route = new ThreadOutputBuf(std::cerr.rdbuf());
+        std::cerr.rdbuf(route);
+        return route;
+    }
+    CaptureBuf  buf;
+    CaptureBuf* previous;
+};
+
+// the number of characters captured by the current thread
+static size_t capturedSize() { return capture_target ? capture_target->size() : 0; }
+
+/**
+ * @brief TestLog gives a test case its own log stream in the thread running it, so LOG_GET only
+ * sees its messages while other test cases run in parallel. The messages are written to the
+ * output of the test case at once, or kept in TestContext::log for the reporter.
+ */
+class TestLog {
+public:
+    TestLog(TestContext& context, bool keep)
+        : stream(std::make_shared<LogStream>()), scope(*stream) {
+        if (!keep) return;
+        stream->setFlushManually();
+        context.log = stream;
+    }
+
+private:
+    std::shared_ptr<LogStream> stream;
+    LogCaptureScope            scope;
+};
+
+#ifndef ZEROERR_NO_THREAD_SAFE
+// the assertions counted by a thread in a test case, only the thread writes them
+struct ThreadCounts {
+    unsigned      passed  = 0;
+    unsigned      warning = 0;
+    unsigned      failed  = 0;
+    ThreadCounts* next    = nullptr;
+};
+
+// the output of a failed assertion in another thread, captured until the assertion ends
+struct ThreadFailure {
+    explicit ThreadFailure(ThreadResults& results)
+        : results(results), capture(new OutputCapture(text)) {}
+
+    ThreadResults&                 results;
+    std::stringbuf                 text;
+    std::unique_ptr<OutputCapture> capture;
+    ThreadFailure*                 next = nullptr;
+};
+
+// the counters of the current thread in the run of the epoch
+static thread_local uint64_t      thread_epoch  = 0;
+static thread_local ThreadCounts* thread_counts = nullptr;
+
+// push a node to a lock-free list, the list is in the reverse order of the pushes
+template <typename T>
+static void pushNode(std::atomic<T*>& list, T* node) {
+    node->next = list.load(std::memory_order_relaxed);
+    while (!list.compare_exchange_weak(node->next, node, std::memory_order_release,
+                                       std::memory_order_relaxed)) {
+    }
+}
+
+/**
+ * @brief ThreadScope lets the threads started by a test case count their assertions while it
+ * is alive. Their counters and failures are merged into the context at the end, the output of
+ * the failures is written to std::cerr of the test case in the order they happened.
+ */
+class ThreadScope {
+public:
+    explicit ThreadScope(TestContext& context) : context(context) {
+        static std::atomic<uint64_t> epochs(0);
+        results.owner   = std::this_thread::get_id();
+        results.epoch   = ++epochs;
+        context.threads = &results;
+    }
+    ~ThreadScope() {
+        merge();
+        context.threads = nullptr;
+    }
+
+    ThreadScope(const ThreadScope&)            = delete;
+    ThreadScope& operator=(const ThreadScope&) = delete;
+
+    // merge the results and throw the failed REQUIRE of another thread if it is not thrown yet
+    void finish() {
+        merge();
+        if (results.fatal.load(std::memory_order_acquire) == 2) context.propagate();
+    }
+
+private:
+    void merge() {
+        ThreadCounts* counts = results.counts.exchange(nullptr, std::memory_order_acquire);
+        while (counts) {
+            context.passed_as += counts->passed;
+            context.warning_as += counts->warning;
+            context.failed_as += counts->failed;
+            ThreadCounts* next = counts->next;
+            delete counts;
+            counts = next;
+        }
+        std::vector<ThreadFailure*> failures;
+        for (ThreadFailure* f = results.failures.exchange(nullptr, std::memory_order_acquire); f;
+             f                = f->next)
+            failures.push_back(f);
+        for (auto f = failures.rbegin(); f != failures.rend(); ++f) {
+            std::cerr << (*f)->text.str();
+            delete *f;
+        }
+    }
+
+    TestContext&  context;
+    ThreadResults results;
+};
+#endif
+
+void AssertionScope::finish() {
+#ifndef ZEROERR_NO_THREAD_SAFE
+    failure->capture.reset();
+    pushNode(failure->results.failures, failure);
+#endif
+}
+
+void runWorker(const std::function<void()>& body) {
+    try {
+        body();
+    } catch (const AssertionData&) {
+        // counted and propagated to the thread of the test case already
+    }
+}
+
+#ifdef ZEROERR_OS_UNIX
+/**
+ * @brief FdCapture writes the capture to a file while it is alive, a temporary file or the
+ * given one. If redirect is set, the file descriptors 1 and 2 are redirected to it as well,
+ * so the output of printf, std::cout and the child processes is captured too, only one thread
+ * can redirect them at a time. The file is read back into the capture at the end.
+ */
+class FdCapture {
+public:
+    FdCapture(CaptureBuf& buf, bool redirect, const std::string& name = std::string())
+        : buf(buf), path(name) {
+        flush();
+        file = path.empty() ? makeTempFile(path) : open(path.c_str(), O_RDWR);
+        if (file < 0) return;
+        if (redirect) {
+            out = dup(STDOUT_FILENO);
+            err = dup(STDERR_FILENO);
+            dup2(file, STDOUT_FILENO);
+            dup2(file, STDERR_FILENO);
+        }
+        buf.forwardTo(file);
+    }
+
+    ~FdCapture() {
+        if (file < 0) return;
+        flush();
+        if (out >= 0) {
+            dup2(out, STDOUT_FILENO);
+            dup2(err, STDERR_FILENO);
+            close(out);
+            close(err);
+        }
+        buf.forwardTo(-1);
+        buf.readFile(file, path);
+    }
+
+    FdCapture(const FdCapture&)            = delete;
+    FdCapture& operator=(const FdCapture&) = delete;
+
+private:
+    static void flush() {
+        std::cout.flush();
+        fflush(nullptr);
+    }
+
+    CaptureBuf& buf;
+    std::string path;
+    int         file = -1, out = -1, err = -1;
+};
+#endif
 }  // namespace detail
 
+#ifndef ZEROERR_NO_THREAD_SAFE
+
+#ifdef ZEROERR_OS_UNIX
+static void writeText(int fd, const std::string& str) {
+    for (size_t done = 0; done < str.size();) {
+        ssize_t n = ::write(fd, str.data() + done, str.size() - done);
+        if (n <= 0) return;
+        done += static_cast<size_t>(n);
+    }
+}
+#endif
+
+#ifdef ZEROERR_HAS_BACKTRACE
+static void*            backtrace_frames[64];
+static std::atomic<int> backtrace_size(-1);
+
+// only the frames are taken in the signal handler, the symbols need to allocate memory
+static void backtraceHandler(int) { backtrace_size = backtrace(backtrace_frames, 64); }
+
+// the backtraces of all the other threads: each thread is signaled to take its own
+static std::string threadBacktraces(pid_t hung) {
+    struct sigaction action, previous;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = backtraceHandler;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGURG, &action, &previous);
+
+    std::string out;
+    pid_t       self = static_cast<pid_t>(syscall(SYS_gettid));
+    DIR*        dir  = opendir("/proc/self/task");
+    while (dirent* entry = dir ? readdir(dir) : nullptr) {
+        pid_t tid = static_cast<pid_t>(std::atoi(entry->d_name));
+        if (tid <= 0 || tid == self) continue;
+        out += "\nThread " + std::to_string(tid) + (tid == hung ? " (running the test case)" : "") +
+               ":\n";
+        backtrace_size = -1;
+        if (syscall(SYS_tgkill, getpid(), tid, SIGURG) != 0) continue;
+        // a thread blocking the signal does not answer
+        for (int k = 0; k < 1000 && backtrace_size < 0; ++k)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        int size = backtrace_size;
+        if (size < 0) {
+            out += "    no answer\n";
+            continue;
+        }
+        char** symbols = backtrace_symbols(backtrace_frames, size);
+        // the first frame is the signal handler
+        for (int i = 1; i < size; ++i) {
+            out += "    ";
+            out += symbols ? symbols[i] : "?";
+            out += '\n';
+        }
+        free(symbols);
+    }
+    if (dir) closedir(dir);
+    sigaction(SIGURG, &previous, nullptr);
+    return out;
+}
+#endif
+
+/**
+ * @brief Watchdog checks the test cases running over their time limits in a thread. A thread
+ * can not be stopped safely, so it prints the backtraces of all the threads and exits the
+ * process when a test case hangs. With --isolate, only the child process exits and the parent
+ * reports the test case and runs the others.
+ */
+class Watchdog {
+public:
+    Watchdog() : thread([this] { loop(); }) {
+#ifdef ZEROERR_OS_UNIX
+        // the captures may redirect stderr later
+        error = dup(STDERR_FILENO);
+#endif
+#ifdef ZEROERR_HAS_BACKTRACE
+        // the first call loads libgcc, it can not be done in a signal handler
+        void* frame;
+        backtrace(&frame, 1);
+#endif
+    }
+
+    ~Watchdog() {
+        {
+            ZEROERR_LOCK(mutex);
+            done = true;
+        }
+        changed.notify_all();
+        thread.join();
+#ifdef ZEROERR_OS_UNIX
+        if (error >= 0) close(error);
+#endif
+    }
+
+    // Scope watches a test case run by the current thread while it is alive
+    class Scope {
+    public:
+        Scope(Watchdog* watchdog, const TestCase& tc, double limit)
+            : watchdog(limit > 0 ? watchdog : nullptr) {
+            if (this->watchdog) id = this->watchdog->watch(tc, limit);
+        }
+        ~Scope() {
+            if (watchdog) watchdog->release(id);
+        }
+
+        Scope(const Scope&)            = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        Watchdog* watchdog;
+        size_t    id = 0;
+    };
+
+private:
+    using clock = std::chrono::steady_clock;
+
+    struct Entry {
+        const TestCase*   tc;
+        double            limit;
+        clock::time_point start;
+        long              thread;  // the id of the thread in the system, 0 if it is unknown
+    };
+
+    size_t watch(const TestCase& tc, double limit) {
+        long thread = 0;
+#ifdef ZEROERR_HAS_BACKTRACE
+        thread = syscall(SYS_gettid);
+#endif
+        size_t id;
+        {
+            ZEROERR_LOCK(mutex);
+            id = next_id++;
+            entries[id] = {&tc, limit, clock::now(), thread};
+        }
+        changed.notify_all();
+        return id;
+    }
+
+    void release(size_t id) {
+        ZEROERR_LOCK(mutex);
+        entries.erase(id);
+    }
+
+    static clock::time_point deadline(const Entry& e) {
+        return e.start + std::chrono::duration_cast<clock::duration>(
+                             std::chrono::duration<double>(e.limit));
+    }
+
+    void loop() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!done) {
+            if (entries.empty()) {
+                changed.wait(lock);
+                continue;
+            }
+            auto first = entries.begin();
+            for (auto p = entries.begin(); p != entries.end(); ++p)
+                if (deadline(p->second) < deadline(first->second)) first = p;
+            if (clock::now() >= deadline(first->second)) timeout(first->second);
+            changed.wait_until(lock, deadline(first->second));
+        }
+    }
+
+    // report a hung test case and exit, the lock is held so no test case finishes meanwhile
+    [[noreturn]] void timeout(const Entry& e) {
+        std::chrono::duration<double> elapsed = clock::now() - e.start;
+        std::ostringstream            message;
+        message << std::endl
+                << "Timeout: " << e.tc->name << " (" << e.tc->file << ":" << e.tc->line
+                << ") has run for " << elapsed.count() << "s, over its limit of " << e.limit
+                << "s" << std::endl;
+#ifdef ZEROERR_HAS_BACKTRACE
+        message << threadBacktraces(static_cast<pid_t>(e.thread));
+#endif
+        // written at once, so the reports of the child processes are not mixed
+#ifdef ZEROERR_OS_UNIX
+        writeText(error, message.str());
+#else
+        fputs(message.str().c_str(), stderr);
+#endif
+        std::_Exit(ZEROERR_TIMEOUT_EXIT_CODE);
+    }
+
+    std::mutex              mutex;
+    std::condition_variable changed;
+    std::map<size_t, Entry> entries;
+    size_t                  next_id = 0;
+    bool                    done    = false;
+    int                     error   = -1;  // a copy of stderr
+    std::thread             thread;
+};
+
+#endif
+
+detail::AssertionScope TestContext::countInThread(const AssertionData& data) {
+#ifndef ZEROERR_NO_THREAD_SAFE
+    using namespace detail;
+    if (thread_epoch != threads->epoch) {
+        thread_counts = new ThreadCounts();
+        thread_epoch  = threads->epoch;
+        pushNode(threads->counts, thread_counts);
+    }
+    if (data.passed) {
+        thread_counts->passed++;
+        return {};
+    }
+    if (data.info.level == assert_level::ZEROERR_WARN_l) {
+        thread_counts->warning++;
+    } else {
+        // the first failed REQUIRE stops the test case in its own thread as well
+        thread_counts->failed++;
+        int none = 0;
+        if (threads->fatal.compare_exchange_strong(none, 1)) {
+            threads->error = std::make_exception_ptr(data);
+            threads->fatal.store(2, std::memory_order_release);
+        }
+    }
+    return AssertionScope(new ThreadFailure(*threads));
+#else
+    (void)data;
+    return {};
+#endif
+}
+
+void TestContext::propagate() {
+#ifndef ZEROERR_NO_THREAD_SAFE
+    int stored = 2;
+    if (threads->fatal.compare_exchange_strong(stored, 3)) std::rethrow_exception(threads->error);
+#endif
+}
+
 // This function update both sum and local.
 // Local need to be updated since the reporter needs to know the result of the subcase.
 int TestContext::add(TestContext& local) {
@@ -45,11 +731,11 @@ int TestContext::add(TestContext& local) {
 void TestContext::save_output() {
     std::fstream file;
     file.open("output.txt", std::ios::in);
-    std::stringbuf* outbuf = static_cast<std::stringbuf*>(std::cerr.rdbuf());
+    std::string output = detail::capture_target ? detail::capture_target->str() : "";
     if (file.is_open()) {
         std::stringstream buffer;
         buffer << file.rdbuf();
-        if (buffer.str() != outbuf->str()) {
+        if (buffer.str() != output) {
             std::cerr << "Output mismatch" << std::endl;
             throw std::runtime_error("Output mismatch");
         } else {
@@ -57,7 +743,7 @@ void TestContext::save_output() {
         }
     } else {
         file.open("output.txt", std::ios::out);
-        file << outbuf->str();
+        file << output;
     }
     file.close();
 }
@@ -65,6 +751,7 @@ void TestContext::save_output() {
 void TestContext::reset() {
     passed = warning = failed = skipped = 0;
     passed_as = warning_as = failed_as = skipped_as = 0;
+    log.reset();
 }
 
 static inline std::string getFileName(std::string file) {
@@ -83,28 +770,347 @@ void SubCase::operator<<(std::function<void(TestContext*)> op) {
     func = op;
     std::stringbuf new_buf;
     context->reporter.subCaseStart(*this, new_buf);
-    TestContext     local(context->reporter);
-    std::streambuf* orig_buf = std::cerr.rdbuf();
-    std::cerr.rdbuf(&new_buf);
-    try {
-        op(&local);
-    } catch (const AssertionData&) {
-    } catch (const FuzzFinishedException&) {
-    } catch (const std::exception& e) {
-        std::cerr << e.what() << std::endl;
-        if (local.failed_as == 0) {
-            local.failed_as = 1;
+    TestContext local(context->reporter);
+    {
+        detail::OutputCapture capture(new_buf);
+        detail::TestLog       logs(local, context->log != nullptr);
+        try {
+#ifndef ZEROERR_NO_THREAD_SAFE
+            detail::ThreadScope threads(local);
+            op(&local);
+            threads.finish();
+#else
+            op(&local);
+#endif
+        } catch (const AssertionData&) {
+        } catch (const FuzzFinishedException&) {
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << std::endl;
+            if (local.failed_as == 0) {
+                local.failed_as = 1;
+            }
         }
     }
-    std::cerr.rdbuf(orig_buf);
     int type = context->add(local);
 
     context->reporter.subCaseEnd(*this, new_buf, local, type);
 }
 
+// The weight of a new duration in the average duration of a test case
+#define ZEROERR_HISTORY_WEIGHT 0.3
+
+// A test case shorter than it is never reported as a regression, short ones are noisy
+#define ZEROERR_HISTORY_MIN_REGRESSION 0.01
+
+// The history file used by --rerun-failed and --changed-only if --history is not given
+#define ZEROERR_HISTORY_FILE ".zeroerr_history"
+
+/**
+ * @brief TestHistory keeps the results of the test cases in the previous runs. It is loaded
+ * from the file given by --history=path before the run and saved after it, the records of the
+ * test cases which are not run are kept. A test case is identified by its file and name.
+ *
+ * Each line of the file is a record separated by tabs: file, name, the average duration in
+ * seconds, the number of runs, failures and flips, whether the last run failed and the hash of
+ * the sources when it passed the last time. Only the duration is required.
+ */
+struct TestHistory {
+    struct Record {
+        double   duration = 0;
+        unsigned runs     = 0;
+        unsigned failures = 0;
+        unsigned flips    = 0;  // the times the result changed from the previous run
+        bool     failed   = false;
+        uint64_t source   = 0;  // the hash of the sources in the last passed run, 0 if unknown
+    };
+
+    // a test case slower than its average duration
+    struct Regression {
+        std::string name, file;
+        unsigned    line;
+        double      before, after;
+    };
+
+    std::map<std::string, Record> records;
+    std::vector<Regression>       regressions;
+
+    // the files included by each source file, and the hashes of the files read in this run
+    std::map<std::string, std::vector<std::string>> dependencies;
+    std::map<std::string, uint64_t>                 hashes;
+
+    static std::string key(const TestCase& tc) { return tc.file + '\t' + tc.name; }
+
+    void load(const std::string& path) {
+        std::ifstream file(path);
+        std::string   line;
+        while (std::getline(file, line)) {
+            size_t name = line.find('\t');
+            size_t data = name == std::string::npos ? name : line.find('\t', name + 1);
+            if (data == std::string::npos) continue;
+            std::istringstream fields(line.substr(data + 1));
+            Record             record;
+            if (!(fields >> record.duration)) continue;
+            fields >> record.runs >> record.failures >> record.flips >> record.failed >>
+                record.source;
+            records[line.substr(0, data)] = record;
+        }
+    }
+
+    // write a new file and rename it, so a reader never sees a partial file
+    void save(const std::string& path) const {
+        std::string temp = path + ".tmp";
+        {
+            std::ofstream file(temp);
+            file << std::setprecision(9);
+            for (auto& p : records) {
+                const Record& r = p.second;
+                file << p.first << '\t' << r.duration << '\t' << r.runs << '\t' << r.failures
+                     << '\t' << r.flips << '\t' << r.failed << '\t' << r.source << '\n';
+            }
+        }
+        std::rename(temp.c_str(), path.c_str());
+    }
+
+    const Record* find(const TestCase& tc) const {
+        auto p = records.find(key(tc));
+        return p == records.end() ? nullptr : &p->second;
+    }
+
+    // the FNV-1a hash of the content of a file, 0 if it can not be read
+    uint64_t fileHash(const std::string& path) {
+        auto p = hashes.find(path);
+        if (p != hashes.end()) return p->second;
+
+        std::ifstream file(path, std::ios::binary);
+        uint64_t      hash = 0;
+        if (file) {
+            hash = 14695981039346656037ull;
+            char buf[4096];
+            while (file.read(buf, sizeof(buf)) || file.gcount() > 0) {
+                for (std::streamsize i = 0; i < file.gcount(); ++i) {
+                    hash ^= static_cast<unsigned char>(buf[i]);
+                    hash *= 1099511628211ull;
+                }
+            }
+            if (hash == 0) hash = 1;
+        }
+        hashes[path] = hash;
+        return hash;
+    }
+
+    // the hash of the file of a test case and the files it includes, 0 if one can not be read
+    uint64_t sourceHash(const TestCase& tc) {
+        uint64_t hash = fileHash(tc.file);
+        auto     deps = dependencies.find(tc.file);
+        if (deps == dependencies.end() || hash == 0) return hash;
+        for (auto& dep : deps->second) {
+            uint64_t h = fileHash(dep);
+            if (h == 0) return 0;
+            hash = (hash ^ h) * 1099511628211ull;
+        }
+        return hash;
+    }
+
+    /**
+     * @brief read a dependency file in the make format written by the compiler (-MD)
+     * @details The first prerequisite is the source file, the others are the files it
+     * includes. A space in a path is escaped by a backslash.
+     */
+    void loadDependencies(const std::string& path) {
+        std::ifstream            file(path);
+        std::vector<std::string> files;
+        std::string              word;
+        bool                     target = true;
+        char                     c;
+        while (file.get(c)) {
+            if (c == '\\' && file.peek() == ' ') {
+                word += static_cast<char>(file.get());
+                continue;
+            }
+            if (c == '\\' && (file.peek() == '\n' || file.peek() == '\r')) {
+                // a line continued by a backslash
+                if (file.get() == '\r' && file.peek() == '\n') file.get();
+                c = ' ';
+            }
+            if (c != ' ' && c != '\t' && c != '\n' && c != '\r') {
+                word += c;
+                continue;
+            }
+            if (target && !word.empty() && word.back() == ':')
+                target = false;
+            else if (!target && !word.empty())
+                files.push_back(word);
+            word.clear();
+            // only the first rule, -MP adds empty rules for the headers after it
+            if (c == '\n' && !target) break;
+        }
+        if (!target && !word.empty()) files.push_back(word);
+        if (files.empty()) return;
+        std::vector<std::string>& deps = dependencies[files[0]];
+        deps.insert(deps.end(), files.begin() + 1, files.end());
+    }
+
+    /**
+     * @brief add the result of a test case
+     * @param threshold A test case slower than its average by this ratio is a regression,
+     * 0 to disable the check.
+     */
+    void update(const TestCase& tc, const TestContext& ctx, bool failed, double threshold) {
+        double duration = ctx.duration.count();
+        auto   p        = records.find(key(tc));
+        if (p == records.end()) {
+            Record& r  = records[key(tc)];
+            r.duration = duration;
+            r.runs     = 1;
+            r.failures = failed;
+            r.failed   = failed;
+            r.source   = failed ? 0 : sourceHash(tc);
+            return;
+        }
+
+        Record& r = p->second;
+        if (!failed) r.source = sourceHash(tc);
+        if (threshold > 0 && duration >= ZEROERR_HISTORY_MIN_REGRESSION &&
+            duration > r.duration * (1 + threshold))
+            regressions.push_back({tc.name, tc.file, tc.line, r.duration, duration});
+
+        r.duration = r.runs ? r.duration + (duration - r.duration) * ZEROERR_HISTORY_WEIGHT
+                            : duration;
+        if (r.runs && r.failed != failed) r.flips++;
+        r.runs++;
+        r.failures += failed;
+        r.failed = failed;
+    }
+};
+
+/**
+ * @brief Pattern is a regular expression of a filter, it matches the whole string.
+ * @details The common patterns: characters, '.', classes like [a-z] and \\d, and the
+ * quantifiers '*', '+' and '?' on them, are compiled into a small automaton which runs in
+ * linear time without backtracking. The other patterns fall back to std::regex.
+ */
+class Pattern {
+public:
+    explicit Pattern(const std::string& pattern) {
+        if (!compile(pattern)) regex.reset(new std::regex(pattern));
+    }
+
+    bool match(const std::string& str) const {
+        if (regex) return std::regex_match(str, *regex);
+
+        // the set of the atoms reached so far, atoms.size() is the end of the pattern
+        std::vector<char> states(atoms.size() + 1, 0), next(atoms.size() + 1, 0);
+        states[0] = 1;
+        skipOptional(states);
+        for (unsigned char c : str) {
+            std::fill(next.begin(), next.end(), 0);
+            bool alive = false;
+            for (size_t i = 0; i < atoms.size(); ++i) {
+                if (!states[i] || !atoms[i].chars[c]) continue;
+                next[i + 1] = 1;
+                if (atoms[i].repeat) next[i] = 1;
+                alive = true;
+            }
+            if (!alive) return false;
+            skipOptional(next);
+            states.swap(next);
+        }
+        return states[atoms.size()] != 0;
+    }
+
+private:
+    struct Atom {
+        std::bitset<256> chars;
+        bool             optional = false;
+        bool             repeat   = false;
+    };
+
+    std::vector<Atom>           atoms;
+    std::unique_ptr<std::regex> regex;  // nullptr if the pattern is compiled into the atoms
+
+    void skipOptional(std::vector<char>& states) const {
+        for (size_t i = 0; i < atoms.size(); ++i)
+            if (states[i] && atoms[i].optional) states[i + 1] = 1;
+    }
+
+    // add the characters of an escape like \\d, false if it is not supported
+    static bool escape(char c, std::bitset<256>& chars) {
+        unsigned char    u = static_cast<unsigned char>(c);
+        std::bitset<256> set;
+        for (unsigned x = 0; x < 256; ++x) {
+            switch (std::tolower(u)) {
+                case 'd': set[x] = std::isdigit(static_cast<int>(x)) != 0; break;
+                case 'w': set[x] = std::isalnum(static_cast<int>(x)) != 0 || x == '_'; break;
+                case 's': set[x] = std::isspace(static_cast<int>(x)) != 0; break;
+                default:
+                    if (std::isalnum(u)) return false;
+                    set[x] = x == u;
+            }
+        }
+        if (std::isupper(u)) set.flip();
+        chars |= set;
+        return true;
+    }
+
+    // a class like [^a-z_], i is after '['
+    static bool parseClass(const std::string& p, size_t& i, std::bitset<256>& chars) {
+        bool negate = i < p.size() && p[i] == '^';
+        if (negate) i++;
+        for (bool first = true; i < p.size() && (first || p[i] != ']'); first = false) {
+            unsigned char a = static_cast<unsigned char>(p[i++]);
+            if (a == '\\') {
+                if (i >= p.size() || !escape(p[i++], chars)) return false;
+                continue;
+            }
+            if (a == '[') return false;  // [:alpha:] and the like
+            if (i + 1 < p.size() && p[i] == '-' && p[i + 1] != ']') {
+                unsigned char b = static_cast<unsigned char>(p[i + 1]);
+                if (b == '\\' || b < a) return false;
+                for (unsigned x = a; x <= b; ++x) chars.set(x);
+                i += 2;
+            } else {
+                chars.set(a);
+            }
+        }
+        if (i >= p.size()) return false;
+        i++;
+        if (negate) chars.flip();
+        return true;
+    }
+
+    bool compile(const std::string& p) {
+        for (size_t i = 0; i < p.size();) {
+            Atom atom;
+            char c = p[i++];
+            if (c == '.') {
+                atom.chars.set();
+                atom.chars.reset('\n');
+                atom.chars.reset('\r');
+            } else if (c == '[') {
+                if (!parseClass(p, i, atom.chars)) return false;
+            } else if (c == '\\') {
+                if (i >= p.size() || !escape(p[i++], atom.chars)) return false;
+            } else if (std::strchr("()|{}^$*+?]", c)) {
+                return false;
+            } else {
+                atom.chars.set(static_cast<unsigned char>(c));
+            }
+
+            if (i < p.size() && std::strchr("*+?", p[i])) {
+                atom.optional = p[i] != '+';
+                atom.repeat   = p[i] != '?';
+                // lazy and possessive quantifiers are left to std::regex
+                if (++i < p.size() && std::strchr("*+?{", p[i])) return false;
+            }
+            atoms.push_back(atom);
+        }
+        return true;
+    }
+};
+
 struct Filters {
-    std::vector<std::regex> name, name_exclude;
-    std::vector<std::regex> file, file_exclude;
+    std::vector<Pattern> name, name_exclude;
+    std::vector<Pattern> file, file_exclude;
 };
 
 UnitTest& UnitTest::parseArgs(int argc, const char** argv) {
@@ -145,6 +1151,28 @@ UnitTest& UnitTest::parseArgs(int argc, const char** argv) {
         return false;
     };
 
+    // the value of a numeric option after prefix, a value which is not a number in [min, max],
+    // or not an integer if integer is set, is an error of the arguments
+    auto parse_number = [&](const std::string& arg, size_t prefix, double min, double max,
+                            bool integer) {
+        std::string text  = arg.substr(prefix);
+        char*       end   = nullptr;
+        double      value = std::strtod(text.c_str(), &end);
+        if (text.empty() || std::isspace(static_cast<unsigned char>(text[0])) || *end != '\0' ||
+            !(value >= min && value <= max) || (integer && value != std::floor(value))) {
+            if (args_error.empty()) args_error = "invalid value of --" + arg;
+            return min;
+        }
+        return value;
+    };
+    auto parse_unsigned = [&](const std::string& arg, size_t prefix) {
+        return static_cast<unsigned>(
+            parse_number(arg, prefix, 0, std::numeric_limits<unsigned>::max(), true));
+    };
+    auto parse_real = [&](const std::string& arg, size_t prefix) {
+        return parse_number(arg, prefix, 0, std::numeric_limits<double>::max(), false);
+    };
+
     auto parse_token = [&](std::string arg) {
         if (arg == "verbose") {
             this->silent = false;
@@ -170,24 +1198,80 @@ UnitTest& UnitTest::parseArgs(int argc, const char** argv) {
         if (arg == "log-to-report") {
             this->log_to_report = true;
         }
+        if (arg == "assertion-report") {
+            this->assertion_report = 10;
+            return true;
+        }
+        if (arg == "isolate") {
+            this->isolate = true;
+            return true;
+        }
+        if (arg == "isolate=each") {
+            this->isolate_each = true;
+            return true;
+        }
+        if (arg == "capture-fd") {
+            this->capture_fd = true;
+            return true;
+        }
+        if (arg == "rerun-failed") {
+            this->rerun_failed = true;
+            return true;
+        }
+        if (arg == "changed-only") {
+            this->changed_only = true;
+            return true;
+        }
+        if (arg.substr(0, 5) == "deps=") {
+            this->deps_path = arg.substr(5);
+            return true;
+        }
+        if (arg.substr(0, 12) == "shard-index=") {
+            this->shard_index = parse_unsigned(arg, 12);
+            return true;
+        }
+        if (arg.substr(0, 12) == "shard-count=") {
+            this->shard_count = parse_unsigned(arg, 12);
+            return true;
+        }
+        if (arg.substr(0, 21) == "regression-threshold=") {
+            this->regression_threshold = parse_real(arg, 21);
+            return true;
+        }
+        if (arg.substr(0, 8) == "history=") {
+            this->history_path = arg.substr(8);
+            return true;
+        }
+        if (arg.substr(0, 8) == "timeout=") {
+            this->timeout = parse_real(arg, 8);
+            return true;
+        }
+        if (arg.substr(0, 5) == "jobs=") {
+            this->jobs = parse_unsigned(arg, 5);
+            return true;
+        }
+        if (arg.substr(0, 17) == "assertion-report=") {
+            this->assertion_report = parse_unsigned(arg, 17);
+            return true;
+        }
         if (arg.substr(0, 9) == "reporters") {
             this->reporter_name = arg.substr(10);
             return true;
         }
-        if (arg.substr(0, 8) == "testcase") {
-            filters->name.push_back(std::regex(arg.substr(9)));
+        if (arg.substr(0, 9) == "testcase=") {
+            filters->name.emplace_back(arg.substr(9));
             return true;
         }
-        if (arg.substr(0, 16) == "testcase-exclude=") {
-            filters->name_exclude.push_back(std::regex(arg.substr(16)));
+        if (arg.substr(0, 17) == "testcase-exclude=") {
+            filters->name_exclude.emplace_back(arg.substr(17));
             return true;
         }
         if (arg.substr(0, 5) == "file=") {
-            filters->file.push_back(std::regex(arg.substr(5)));
+            filters->file.emplace_back(arg.substr(5));
             return true;
         }
         if (arg.substr(0, 13) == "file-exclude=") {
-            filters->file_exclude.push_back(std::regex(arg.substr(13)));
+            filters->file_exclude.emplace_back(arg.substr(13));
             return true;
         }
         return false;
@@ -206,6 +1290,13 @@ UnitTest& UnitTest::parseArgs(int argc, const char** argv) {
     auto args = convert_to_vec();
     for (size_t i = 0; i < args.size(); ++i) parse_pos(args, i);
 
+    // a wrong shard would run no test case or all of them and pass silently
+    if (args_error.empty() && shard_count == 0)
+        args_error = "--shard-count must be at least 1";
+    else if (args_error.empty() && shard_index >= shard_count)
+        args_error = "--shard-index=" + std::to_string(shard_index) +
+                     " must be less than --shard-count=" + std::to_string(shard_count);
+
     binary = argv[0];
     return *this;
 }
@@ -226,13 +1317,13 @@ static std::string insertIndentation(std::string str) {
 bool UnitTest::run_filter(const TestCase& tc) {
     if (filters == nullptr) return true;
     for (auto& r : filters->name)
-        if (!std::regex_match(tc.name, r)) return false;
+        if (!r.match(tc.name)) return false;
     for (auto& r : filters->name_exclude)
-        if (std::regex_match(tc.name, r)) return false;
+        if (r.match(tc.name)) return false;
     for (auto& r : filters->file)
-        if (!std::regex_match(tc.file, r)) return false;
+        if (!r.match(tc.file)) return false;
     for (auto& r : filters->file_exclude)
-        if (std::regex_match(tc.file, r)) return false;
+        if (r.match(tc.file)) return false;
     return true;
 }
 
@@ -253,7 +1344,836 @@ static bool runOnFinish(const TestCase& tc, TestContext& ctx) {
     return contain_changes;
 }
 
+// print the sites evaluated most often and the sites failed most often
+static void reportAssertionSites(unsigned top) {
+    std::vector<const AssertionSite*> sites = getAssertionSites();
+
+    auto print = [&](const char* title, std::function<uint64_t(const AssertionSite*)> key) {
+        std::stable_sort(sites.begin(), sites.end(),
+                         [&](const AssertionSite* a, const AssertionSite* b) {
+                             return key(a) > key(b);
+                         });
+        Table output;
+        output.set_header({"site", "condition", "evaluations", "failures", "warnings"});
+        for (size_t i = 0; i < sites.size() && i < top; ++i) {
+            const AssertionSite* p = sites[i];
+            if (key(p) == 0) break;
+            std::string cond = p->cond.size() > 60 ? p->cond.substr(0, 57) + "..." : p->cond;
+            output.add_row({std::string(p->file) + ":" + std::to_string(p->line), cond,
+                            std::to_string(ZEROERR_LOAD(p->evaluations)),
+                            std::to_string(ZEROERR_LOAD(p->failures)),
+                            std::to_string(ZEROERR_LOAD(p->warnings))});
+        }
+        std::cerr << title << ":" << std::endl << output.str() << std::endl;
+    };
+
+    print("Hottest assertions",
+          [](const AssertionSite* p) { return uint64_t(ZEROERR_LOAD(p->evaluations)); });
+    print("Most failed assertions", [](const AssertionSite* p) {
+        return uint64_t(ZEROERR_LOAD(p->failures) + ZEROERR_LOAD(p->warnings));
+    });
+}
+
+// run the body of a test case, the output is captured into the buffer, it is written to the
+// file while the test case runs if one is given
+static void runTestCase(UnitTest& ut, const TestCase& tc, TestContext& context,
+                        std::stringbuf& buf, bool capture_fd = false,
+                        const std::string& file = std::string()) {
+    detail::OutputCapture capture(buf);
+    detail::TestLog       logs(context, ut.log_to_report);
+#ifdef ZEROERR_OS_UNIX
+    std::unique_ptr<detail::FdCapture> fds(
+        capture_fd || !file.empty() ? new detail::FdCapture(capture.buffer(), capture_fd, file)
+                                    : nullptr);
+#else
+    (void)capture_fd;
+    (void)file;
+#endif
+#ifndef ZEROERR_NO_THREAD_SAFE
+    // only --timeout stops a test case, timeout() fails a slow one when it finishes
+    Watchdog::Scope watch(ut.watchdog, tc, ut.timeout);
+#else
+    (void)ut;
+#endif
+    std::cerr << std::endl;
+    auto start = std::chrono::high_resolution_clock::now();
+    try {
+#ifndef ZEROERR_NO_THREAD_SAFE
+        detail::ThreadScope threads(context);
+        tc.func(&context);  // run the test case
+        threads.finish();
+#else
+        tc.func(&context);  // run the test case
+#endif
+    } catch (const AssertionData&) {
+    } catch (const FuzzFinishedException&) {
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        if (context.failed_as == 0) {
+            context.failed_as = 1;
+        }
+    }
+    auto end         = std::chrono::high_resolution_clock::now();
+    context.duration = end - start;
+}
+
+// report a finished test case, decorators may rewrite pass/fail before results are accumulated
+static void reportTestCase(UnitTest& ut, IReporter& reporter, const TestCase& tc,
+                           TestContext& context, std::stringbuf& buf, TestContext& sum) {
+    runOnFinish(tc, context);
+    int type = sum.add(context);
+    if (ut.history && !ut.list_test_cases)
+        ut.history->update(tc, context, type == 2, ut.regression_threshold);
+    reporter.testCaseEnd(tc, buf, context, type);
+}
+
+// print the test cases which are slower than their average durations in the history
+static void reportRegressions(const TestHistory& history, double threshold) {
+    if (history.regressions.empty()) return;
+    Table output;
+    output.set_header({"test case", "file", "average", "this run", "slower"});
+    for (auto& r : history.regressions) {
+        output.add_row({r.name, getFileName(r.file) + ":" + std::to_string(r.line),
+                        std::to_string(r.before) + "s", std::to_string(r.after) + "s",
+                        std::to_string(static_cast<int>((r.after / r.before - 1) * 100)) + "%"});
+    }
+    std::cerr << "Test cases " << static_cast<int>(threshold * 100)
+              << "% slower than the history:" << std::endl
+              << output.str() << std::endl;
+}
+
+namespace detail {
+// ResultWriter and ResultReader encode the results of a test case run by a child process
+class ResultWriter {
+public:
+    void u32(uint32_t value) { data.append(reinterpret_cast<const char*>(&value), sizeof(value)); }
+    void u64(uint64_t value) { data.append(reinterpret_cast<const char*>(&value), sizeof(value)); }
+    void f64(double value) { data.append(reinterpret_cast<const char*>(&value), sizeof(value)); }
+    void str(const std::string& value) {
+        u32(static_cast<uint32_t>(value.size()));
+        data += value;
+    }
+
+    void context(const TestContext& ctx) {
+        for (unsigned value : {ctx.passed, ctx.warning, ctx.failed, ctx.skipped, ctx.passed_as,
+                               ctx.warning_as, ctx.failed_as, ctx.skipped_as})
+            u32(value);
+        f64(ctx.duration.count());
+    }
+
+    std::string data;
+};
+
+class ResultReader {
+public:
+    explicit ResultReader(const std::string& data) : data(data) {}
+
+    uint32_t u32() { return get<uint32_t>(); }
+    uint64_t u64() { return get<uint64_t>(); }
+    double   f64() { return get<double>(); }
+    std::string str() {
+        size_t size = u32();
+        pos += size;
+        return data.substr(pos - size, size);
+    }
+
+    void context(TestContext& ctx) {
+        for (unsigned* value : {&ctx.passed, &ctx.warning, &ctx.failed, &ctx.skipped,
+                                &ctx.passed_as, &ctx.warning_as, &ctx.failed_as, &ctx.skipped_as})
+            *value = u32();
+        ctx.duration = std::chrono::duration<double>(f64());
+    }
+
+private:
+    template <typename T>
+    T get() {
+        T value;
+        memcpy(&value, data.data() + pos, sizeof(T));
+        pos += sizeof(T);
+        return value;
+    }
+
+    const std::string& data;
+    size_t             pos = 0;
+};
+}  // namespace detail
+
+/**
+ * @brief DeferredReporter records the sub case events of a test case running in a worker
+ * thread. They are replayed to the reporter in the main thread when the test case is
+ * reported, and the output is split at the same positions as a sequential run.
+ */
+class DeferredReporter : public IReporter {
+public:
+    DeferredReporter(UnitTest& ut, IReporter& target) : IReporter(ut), target(target) {}
+
+    std::string getName() const override { return target.getName(); }
+
+    void testStart() override {}
+    void testCaseStart(const TestCase&, std::stringbuf&) override {}
+    void testCaseEnd(const TestCase&, std::stringbuf&, const TestContext&, int) override {}
+    void testEnd(const TestContext&) override {}
+
+    void subCaseStart(const TestCase& tc, std::stringbuf&) override {
+        events.push_back({tc, false, detail::capturedSize(), std::string(), TestContext(*this), 0});
+    }
+
+    void subCaseEnd(const TestCase& tc, std::stringbuf& sb, const TestContext& ctx,
+                    int type) override {
+        events.push_back({tc, true, detail::capturedSize(), sb.str(), ctx, type});
+    }
+
+    void write(detail::ResultWriter& out) const {
+        out.u32(static_cast<uint32_t>(events.size()));
+        for (auto& e : events) {
+            out.str(e.tc.name);
+            out.str(e.tc.file);
+            out.u32(e.tc.line);
+            out.u32(e.end);
+            out.u64(e.offset);
+            out.str(e.output);
+            out.context(e.ctx);
+            out.u32(static_cast<uint32_t>(e.type));
+        }
+    }
+
+    void read(detail::ResultReader& in) {
+        for (uint32_t n = in.u32(); n > 0; --n) {
+            std::string name = in.str(), file = in.str();
+            unsigned    line = in.u32();
+            bool        end  = in.u32() != 0;
+            size_t      offset = static_cast<size_t>(in.u64());
+            events.push_back({TestCase(name, file, line, {}), end, offset, in.str(),
+                              TestContext(*this), 0});
+            in.context(events.back().ctx);
+            events.back().type = static_cast<int>(in.u32());
+        }
+    }
+
+    // replay the events with the captured output of the test case into buf
+    void replay(const std::string& output, std::stringbuf& buf) {
+        struct Frame {
+            const std::string* text;     // the captured output of this level
+            size_t             written;  // the size of the text written into sink
+            std::stringbuf*    sink;     // the buffer given to the reporter
+        };
+
+        // the end event of a sub case holds its output
+        std::vector<size_t> ends(events.size()), open;
+        for (size_t i = 0; i < events.size(); ++i) {
+            if (!events[i].end) {
+                open.push_back(i);
+            } else {
+                ends[open.back()] = i;
+                open.pop_back();
+            }
+        }
+
+        // the offsets after the head of a long output are not in the text
+        auto write = [](Frame& frame, size_t offset) {
+            offset = std::max(frame.written, std::min(offset, frame.text->size()));
+            frame.sink->sputn(frame.text->data() + frame.written,
+                              static_cast<std::streamsize>(offset - frame.written));
+            frame.written = offset;
+        };
+
+        std::vector<Frame> frames{{&output, 0, &buf}};
+        for (size_t i = 0; i < events.size(); ++i) {
+            Event& e = events[i];
+            if (!e.end) {
+                write(frames.back(), e.offset);
+                std::stringbuf* sink = new std::stringbuf();
+                {
+                    detail::OutputCapture capture(*frames.back().sink);
+                    target.subCaseStart(e.tc, *sink);
+                }
+                frames.push_back({&events[ends[i]].output, 0, sink});
+            } else {
+                Frame sub = frames.back();
+                frames.pop_back();
+                write(sub, sub.text->size());
+                write(frames.back(), e.offset);
+                {
+                    detail::OutputCapture capture(*frames.back().sink);
+                    target.subCaseEnd(e.tc, *sub.sink, e.ctx, e.type);
+                }
+                delete sub.sink;
+            }
+        }
+        write(frames.back(), output.size());
+    }
+
+private:
+    struct Event {
+        TestCase    tc;
+        bool        end;
+        size_t      offset;  // the size of the output captured by the parent at the event
+        std::string output;  // the output of the sub case at the end event
+        TestContext ctx;
+        int         type;
+    };
+
+    IReporter&         target;
+    std::vector<Event> events;
+};
+
+// run a test case with the file descriptors captured, the reporter may write to std::cout so
+// the sub case events are replayed after the capture
+static void runCaptured(UnitTest& ut, IReporter& reporter, const TestCase& tc,
+                        std::stringbuf& buf, TestContext& sum) {
+    DeferredReporter events(ut, reporter);
+    TestContext      context(events);
+    std::stringbuf   output;
+    runTestCase(ut, tc, context, output, true);
+    events.replay(output.str(), buf);
+    reportTestCase(ut, reporter, tc, context, buf, sum);
+}
+
+// serial test cases, benchmarks and fuzz tests are not run with other test cases
+static bool runAlone(const TestCase& tc) {
+    auto& benches    = detail::getRegisteredTests(TestType::bench);
+    auto& fuzz_tests = detail::getRegisteredTests(TestType::fuzz_test);
+    return std::find(tc.decorators.begin(), tc.decorators.end(), serial()) !=
+               tc.decorators.end() ||
+           std::binary_search(benches.begin(), benches.end(), tc) ||
+           std::binary_search(fuzz_tests.begin(), fuzz_tests.end(), tc);
+}
+
+// the durations of the test cases in the history, the mean of the others if there is no record
+static std::vector<double> expectedDurations(const std::vector<const TestCase*>& tests,
+                                             const TestHistory*                  history) {
+    std::vector<double> durations(tests.size(), -1);
+    double              total = 0;
+    size_t              known = 0;
+    for (size_t i = 0; i < tests.size(); ++i) {
+        const TestHistory::Record* record = history ? history->find(*tests[i]) : nullptr;
+        if (record == nullptr) continue;
+        durations[i] = record->duration;
+        total += record->duration;
+        known++;
+    }
+    double mean = known ? total / known : 1;
+    for (auto& d : durations)
+        if (d < 0) d = mean;
+    return durations;
+}
+
+// the test cases not run alone, the longest ones first so they do not end the run late
+static std::vector<size_t> scheduleTasks(const std::vector<const TestCase*>& tests,
+                                         const TestHistory*                  history) {
+    std::vector<size_t> tasks;
+    for (size_t i = 0; i < tests.size(); ++i)
+        if (!runAlone(*tests[i])) tasks.push_back(i);
+    std::vector<double> durations = expectedDurations(tests, history);
+    std::stable_sort(tasks.begin(), tasks.end(),
+                     [&](size_t a, size_t b) { return durations[a] > durations[b]; });
+    return tasks;
+}
+
+#ifndef ZEROERR_NO_THREAD_SAFE
+
+/**
+ * @brief WorkStealingPool runs a list of tasks in a few threads. The tasks are dealt to a
+ * queue for each thread in order. A thread takes the tasks from the front of its own queue
+ * and steals from the back of the other queues once its queue is empty.
+ */
+class WorkStealingPool {
+public:
+    WorkStealingPool(unsigned threads, const std::vector<size_t>& tasks,
+                     std::function<void(size_t)> run)
+        : queues(threads), run(run) {
+        for (size_t i = 0; i < tasks.size(); ++i) queues[i % threads].tasks.push_back(tasks[i]);
+        for (unsigned id = 0; id < threads; ++id) workers.emplace_back([this, id] { work(id); });
+    }
+    ~WorkStealingPool() { join(); }
+
+    void join() {
+        for (auto& worker : workers)
+            if (worker.joinable()) worker.join();
+    }
+
+private:
+    struct Queue {
+        std::mutex         mutex;
+        std::deque<size_t> tasks;
+    };
+
+    void work(unsigned id) {
+        size_t task;
+        while (take(id, task)) run(task);
+    }
+
+    // no task is added after the start, so the work is done once all the queues are empty
+    bool take(unsigned id, size_t& task) {
+        for (size_t k = 0; k < queues.size(); ++k) {
+            Queue& q = queues[(id + k) % queues.size()];
+            ZEROERR_LOCK(q.mutex);
+            if (q.tasks.empty()) continue;
+            if (k == 0) {
+                task = q.tasks.front();
+                q.tasks.pop_front();
+            } else {
+                task = q.tasks.back();
+                q.tasks.pop_back();
+            }
+            return true;
+        }
+        return false;
+    }
+
+    std::vector<Queue>          queues;
+    std::function<void(size_t)> run;
+    std::vector<std::thread>    workers;
+};
+
+/**
+ * @brief run the test cases in a work stealing pool and report them in order
+ * @details The main thread waits for each test case in the order of registration, replays
+ * its events to the reporter and adds its results to sum, so the report is the same as a
+ * sequential run.
+ */
+static void runParallel(UnitTest& ut, IReporter& reporter, unsigned threads,
+                        const std::vector<const TestCase*>& tests, TestContext& sum) {
+    struct TestRun {
+        TestRun(UnitTest& ut, IReporter& reporter) : events(ut, reporter), context(events) {}
+        DeferredReporter events;
+        TestContext      context;
+        std::stringbuf   output;
+        bool             done = false;
+    };
+
+    std::vector<std::unique_ptr<TestRun>> runs;
+    for (size_t i = 0; i < tests.size(); ++i) runs.emplace_back(new TestRun(ut, reporter));
+    std::vector<size_t> tasks = scheduleTasks(tests, ut.history);
+
+    std::mutex              mutex;
+    std::condition_variable finished;
+    WorkStealingPool        pool(threads, tasks, [&](size_t i) {
+        runTestCase(ut, *tests[i], runs[i]->context, runs[i]->output);
+        {
+            ZEROERR_LOCK(mutex);
+            runs[i]->done = true;
+        }
+        finished.notify_all();
+    });
+
+    std::stringbuf buf;
+    for (size_t i = 0; i < tests.size(); ++i) {
+        TestRun& run = *runs[i];
+        if (runAlone(*tests[i])) {
+            pool.join();
+            runTestCase(ut, *tests[i], run.context, run.output, ut.capture_fd);
+        } else {
+            std::unique_lock<std::mutex> lock(mutex);
+            finished.wait(lock, [&] { return run.done; });
+        }
+        reporter.testCaseStart(*tests[i], buf);
+        run.events.replay(run.output.str(), buf);
+        reportTestCase(ut, reporter, *tests[i], run.context, buf, sum);
+        buf.str("");
+        runs[i].reset();
+    }
+}
+
+#endif
+
+#ifdef ZEROERR_OS_UNIX
+
+static bool writeAll(int fd, const void* data, size_t size) {
+    const char* p = static_cast<const char*>(data);
+    while (size > 0) {
+        ssize_t n = ::write(fd, p, size);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+static bool readAll(int fd, void* data, size_t size) {
+    char* p = static_cast<char*>(data);
+    while (size > 0) {
+        ssize_t n = ::read(fd, p, size);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+static std::string signalName(int sig) {
+    static const struct {
+        int         sig;
+        const char* name;
+    } names[] = {{SIGSEGV, "SIGSEGV"}, {SIGABRT, "SIGABRT"}, {SIGFPE, "SIGFPE"},
+                 {SIGILL, "SIGILL"},   {SIGBUS, "SIGBUS"},   {SIGTRAP, "SIGTRAP"},
+                 {SIGSYS, "SIGSYS"},   {SIGKILL, "SIGKILL"}, {SIGTERM, "SIGTERM"},
+                 {SIGINT, "SIGINT"},   {SIGPIPE, "SIGPIPE"}};
+    for (auto& n : names)
+        if (n.sig == sig) return std::string(n.name) + " (" + strsignal(sig) + ")";
+    return "signal " + std::to_string(sig);
+}
+
+// a child process running test cases, the parent sends the index of a test case and the path
+// of its output file to the command pipe and receives the results from the result pipe
+struct ChildProcess {
+    static const size_t idle = static_cast<size_t>(-1);
+
+    pid_t       pid     = -1;
+    int         command = -1;
+    int         result  = -1;
+    size_t      task    = idle;
+    double      limit   = 0;      // the time limit of the task, 0 for none
+    bool        killed  = false;  // killed for running over the limit
+    std::string buffer;           // the received part of the results
+    std::string output;           // the file the task writes its output to
+    std::chrono::high_resolution_clock::time_point start;
+};
+
+// the loop of a child process, it runs the test cases until the command pipe is closed
+static void serveTestCases(UnitTest& ut, IReporter& reporter,
+                           const std::vector<const TestCase*>& tests, int command, int result) {
+#ifndef ZEROERR_NO_THREAD_SAFE
+    // the threads of the parent are not in the child, it watches its test cases itself
+    std::unique_ptr<Watchdog> watchdog(ut.timeout > 0 ? new Watchdog() : nullptr);
+    ut.watchdog = watchdog.get();
+#endif
+    uint32_t index, length;
+    while (readAll(command, &index, sizeof(index)) && readAll(command, &length, sizeof(length))) {
+        std::string file(length, '\0');
+        if (length > 0 && !readAll(command, &file[0], length)) break;
+
+        // the output is written to the file, so the parent still has it if the child crashes
+        DeferredReporter events(ut, reporter);
+        TestContext      context(events);
+        std::stringbuf   output;
+        runTestCase(ut, *tests[index], context, output, ut.capture_fd, file);
+
+        detail::ResultWriter out;
+        out.str(output.str());
+        out.context(context);
+        events.write(out);
+        uint32_t size = static_cast<uint32_t>(out.data.size());
+        if (!writeAll(result, &size, sizeof(size)) || !writeAll(result, out.data.data(), size))
+            break;
+        if (ut.isolate_each) break;
+    }
+    std::cout.flush();
+    fflush(nullptr);
+    _exit(0);
+}
+
+/**
+ * @brief run the test cases in child processes and report them in order
+ * @details The children are forked once and reused, or forked for each test case with
+ * isolate_each. A child which crashes or exits is reported as a failure of its test case
+ * and replaced by a new child, so the other test cases still run. The output of a test case is
+ * written to a file given by the parent, so it is kept when the child crashes. A child is
+ * killed if its test case runs ZEROERR_WATCHDOG_GRACE seconds over the time limit, with
+ * --timeout the watchdog of the child normally stops it first and prints the backtraces.
+ */
+static void runIsolated(UnitTest& ut, IReporter& reporter, unsigned processes,
+                        const std::vector<const TestCase*>& tests, TestContext& sum) {
+    struct TestRun {
+        TestRun(UnitTest& ut, IReporter& reporter) : events(ut, reporter), context(events) {}
+        DeferredReporter events;
+        TestContext      context;
+        std::string      output;
+        bool             done = false;
+    };
+
+    std::vector<std::unique_ptr<TestRun>> runs;
+    for (size_t i = 0; i < tests.size(); ++i) runs.emplace_back(new TestRun(ut, reporter));
+
+    std::vector<ChildProcess> children(processes);
+    std::vector<size_t>       tasks = scheduleTasks(tests, ut.history);
+    std::deque<size_t>        pending(tasks.begin(), tasks.end());
+    for (size_t i = 0; i < tests.size(); ++i)
+        if (runAlone(*tests[i])) pending.push_back(i);
+    unsigned busy  = 0;
+    bool     alone = false;  // a test case running alone
+
+    auto spawn = [&](ChildProcess& child) {
+        int command[2], result[2];
+        if (pipe(command) != 0) throw std::runtime_error("Failed to create a pipe");
+        if (pipe(result) != 0) {
+            close(command[0]);
+            close(command[1]);
+            throw std::runtime_error("Failed to create a pipe");
+        }
+        // the buffered output would be written again by the child
+        std::cout.flush();
+        fflush(nullptr);
+        pid_t pid = fork();
+        if (pid == 0) {
+            for (auto& other : children) {
+                if (other.pid <= 0) continue;
+                close(other.command);
+                close(other.result);
+            }
+            close(command[1]);
+            close(result[0]);
+            serveTestCases(ut, reporter, tests, command[0], result[1]);
+        }
+        close(command[0]);
+        close(result[1]);
+        if (pid < 0) {
+            close(command[1]);
+            close(result[0]);
+            throw std::runtime_error("Failed to fork a child process");
+        }
+        child.pid     = pid;
+        child.command = command[1];
+        child.result  = result[0];
+    };
+
+    auto stop = [](ChildProcess& child) {
+        close(child.command);
+        close(child.result);
+        int status = 0;
+        while (waitpid(child.pid, &status, 0) < 0 && errno == EINTR) {
+        }
+        child.pid = -1;
+        child.buffer.clear();
+        return status;
+    };
+
+    auto finish = [&](ChildProcess& child) {
+        TestRun& run = *runs[child.task];
+        run.done     = true;
+        if (runAlone(*tests[child.task])) alone = false;
+        child.task   = ChildProcess::idle;
+        child.killed = false;
+        child.buffer.clear();
+        child.output.clear();
+        busy--;
+    };
+
+    // send a test case and a new file for its output to the child
+    auto send = [&](ChildProcess& child, uint32_t index) {
+        int file = detail::makeTempFile(child.output);
+        if (file < 0) throw std::runtime_error("Failed to create a temporary file");
+        close(file);
+        uint32_t length = static_cast<uint32_t>(child.output.size());
+        if (writeAll(child.command, &index, sizeof(index)) &&
+            writeAll(child.command, &length, sizeof(length)) &&
+            writeAll(child.command, child.output.data(), length))
+            return true;
+        unlink(child.output.c_str());
+        return false;
+    };
+
+    auto receive = [&](ChildProcess& child) {
+        char    data[4096];
+        ssize_t n = ::read(child.result, data, sizeof(data));
+        if (n < 0 && errno == EINTR) return;
+        if (n > 0) {
+            child.buffer.append(data, static_cast<size_t>(n));
+            uint32_t size;
+            if (child.buffer.size() < sizeof(size)) return;
+            memcpy(&size, child.buffer.data(), sizeof(size));
+            if (child.buffer.size() < sizeof(size) + size) return;
+
+            TestRun&             run = *runs[child.task];
+            std::string          results = child.buffer.substr(sizeof(size));
+            detail::ResultReader in(results);
+            run.output = in.str();
+            in.context(run.context);
+            run.events.read(in);
+            finish(child);
+            if (ut.isolate_each) stop(child);
+            return;
+        }
+
+        // the child exited before sending the results, its output so far is in the file
+        TestRun&       run    = *runs[child.task];
+        int            status = stop(child);
+        std::stringbuf partial;
+        {
+            detail::CaptureBuf capture(partial);
+            int                file = open(child.output.c_str(), O_RDWR);
+            if (file >= 0) capture.readFile(file, child.output);
+        }
+        std::chrono::duration<double> elapsed =
+            std::chrono::high_resolution_clock::now() - child.start;
+        std::ostringstream message;
+        message << std::endl;
+        // the watchdog of the child exits with ZEROERR_TIMEOUT_EXIT_CODE at --timeout
+        if (child.killed || (child.limit > 0 && elapsed.count() >= child.limit) ||
+            (WIFEXITED(status) && WEXITSTATUS(status) == ZEROERR_TIMEOUT_EXIT_CODE))
+            message << FgRed << "Timeout: " << Reset << elapsed.count() << "s > " << child.limit
+                    << "s";
+        else if (WIFSIGNALED(status))
+            message << FgRed << "Crashed: " << Reset << signalName(WTERMSIG(status));
+        else
+            message << FgRed << "Crashed: " << Reset << "exited with code "
+                    << WEXITSTATUS(status);
+        message << std::endl;
+        run.output            = partial.str() + message.str();
+        run.context.failed_as = 1;
+        run.context.duration  = elapsed;
+        finish(child);
+    };
+
+    // a closed pipe is found by the result of write
+    void (*sigpipe)(int) = signal(SIGPIPE, SIG_IGN);
+
+    std::stringbuf buf;
+    for (size_t next = 0; next < tests.size();) {
+        // send the pending test cases to the idle children
+        for (auto& child : children) {
+            if (pending.empty() || alone) break;
+            if (child.task != ChildProcess::idle) continue;
+            uint32_t index = static_cast<uint32_t>(pending.front());
+            if (runAlone(*tests[index])) {
+                if (busy > 0) break;
+                alone = true;
+            }
+            if (child.pid < 0) spawn(child);
+            if (!send(child, index)) {
+                // the child exited after its last test case
+                stop(child);
+                spawn(child);
+                if (!send(child, index))
+                    throw std::runtime_error("Failed to send a test case to a child process");
+            }
+            pending.pop_front();
+            child.task  = index;
+            child.limit = timeLimit(ut, *tests[index]);
+            child.start = std::chrono::high_resolution_clock::now();
+            busy++;
+        }
+
+        // the finished test cases are reported in order
+        for (; next < tests.size() && runs[next]->done; ++next) {
+            TestRun& run = *runs[next];
+            reporter.testCaseStart(*tests[next], buf);
+            run.events.replay(run.output, buf);
+            reportTestCase(ut, reporter, *tests[next], run.context, buf, sum);
+            buf.str("");
+            runs[next].reset();
+        }
+        if (next == tests.size()) break;
+
+        // wait for the results until the first child to kill, the pipe closes when it is killed
+        std::vector<pollfd>        fds;
+        std::vector<ChildProcess*> polled;
+        int                        wait = -1;
+        auto                       now  = std::chrono::high_resolution_clock::now();
+        for (auto& child : children) {
+            if (child.task == ChildProcess::idle) continue;
+            fds.push_back({child.result, POLLIN, 0});
+            polled.push_back(&child);
+            if (child.limit <= 0 || child.killed) continue;
+
+            double left = child.limit + ZEROERR_WATCHDOG_GRACE -
+                          std::chrono::duration<double>(now - child.start).count();
+            if (left <= 0) {
+                kill(child.pid, SIGKILL);
+                child.killed = true;
+                continue;
+            }
+            int ms = static_cast<int>(left * 1000) + 1;
+            wait   = wait < 0 ? ms : std::min(wait, ms);
+        }
+        if (poll(fds.data(), static_cast<nfds_t>(fds.size()), wait) < 0) {
+            if (errno == EINTR) continue;
+            throw std::runtime_error("Failed to wait for the child processes");
+        }
+        for (size_t k = 0; k < fds.size(); ++k)
+            if (fds[k].revents) receive(*polled[k]);
+    }
+
+    for (auto& child : children)
+        if (child.pid > 0) stop(child);
+    signal(SIGPIPE, sigpipe);
+}
+
+#endif
+
+/**
+ * @brief select the test cases of a shard
+ * @details The test cases are assigned by the longest processing time first: from the longest
+ * one, each test case goes to the shard with the least total duration so far. The duration of
+ * a test case without a record is the mean of the others. All the shards compute the same
+ * assignment if they use the same history file.
+ */
+static std::vector<const TestCase*> selectShard(const std::vector<const TestCase*>& tests,
+                                                unsigned index, unsigned count,
+                                                const TestHistory* history) {
+    std::vector<double> durations = expectedDurations(tests, history);
+    std::vector<size_t> order(tests.size());
+    for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+    std::stable_sort(order.begin(), order.end(),
+                     [&](size_t a, size_t b) { return durations[a] > durations[b]; });
+
+    std::vector<double> loads(count, 0);
+    std::vector<bool>   selected(tests.size(), false);
+    for (size_t i : order) {
+        auto least = std::min_element(loads.begin(), loads.end());
+        auto shard = static_cast<size_t>(least - loads.begin());
+        loads[shard] += durations[i];
+        selected[i] = shard == index;
+    }
+
+    std::vector<const TestCase*> result;
+    for (size_t i = 0; i < tests.size(); ++i)
+        if (selected[i]) result.push_back(tests[i]);
+    return result;
+}
+
+// the dependency files (*.d) in a directory and its subdirectories, or the path of a file
+static void findDependencyFiles(const std::string& path, std::vector<std::string>& files) {
+#ifdef ZEROERR_OS_UNIX
+    if (DIR* dir = opendir(path.c_str())) {
+        while (dirent* entry = readdir(dir)) {
+            std::string name = entry->d_name;
+            std::string file = path + '/' + name;
+            struct stat st;
+            if (name == "." || name == ".." || lstat(file.c_str(), &st) != 0) continue;
+            if (S_ISDIR(st.st_mode))
+                findDependencyFiles(file, files);
+            else if (name.size() > 2 && name.compare(name.size() - 2, 2, ".d") == 0)
+                files.push_back(file);
+        }
+        closedir(dir);
+        return;
+    }
+#endif
+    files.push_back(path);
+}
+
+/**
+ * @brief select the test cases to run again by the history
+ * @details --rerun-failed selects the test cases failed in the last run, or all of them if
+ * none failed. --changed-only also selects the test cases which have not passed with the
+ * current sources: the hash of the file and the files it includes is not the one of the last
+ * passed run, or it is unknown.
+ */
+static std::vector<const TestCase*> selectIncremental(const UnitTest&                     ut,
+                                                      const std::vector<const TestCase*>& tests,
+                                                      TestHistory&                        history) {
+    std::vector<const TestCase*> result;
+    for (auto tc : tests) {
+        const TestHistory::Record* record = history.find(*tc);
+        if (record && record->failed) {
+            result.push_back(tc);
+        } else if (ut.changed_only) {
+            uint64_t hash = history.sourceHash(*tc);
+            if (!record || hash == 0 || record->source != hash) result.push_back(tc);
+        }
+    }
+    if (!ut.changed_only && result.empty()) return tests;
+    return result;
+}
+
 int UnitTest::run() {
+    if (!args_error.empty()) {
+        std::cerr << "zeroerr: " << args_error << std::endl;
+        return ZEROERR_USAGE_EXIT_CODE;
+    }
     IReporter* reporter = IReporter::create(reporter_name, *this);
     if (!reporter) reporter = IReporter::create("console", *this);
 
@@ -261,45 +2181,94 @@ int UnitTest::run() {
     reporter->testStart();
     std::stringbuf new_buf;
 
-    unsigned types = TestType::test_case;
-    if (run_bench) types |= TestType::bench;
-    if (run_fuzz) types |= TestType::fuzz_test;
-    std::set<TestCase> test_cases = detail::getRegisteredTests(types);
+    std::vector<TestType> types = {TestType::test_case};
+    if (run_bench) types.push_back(TestType::bench);
+    if (run_fuzz) types.push_back(TestType::fuzz_test);
 
-    for (auto& tc : test_cases) {
-        if (!run_filter(tc)) continue;
-        if (runOnExecution(tc)) {
-            sum.skipped += 1;
-            continue;
-        }
-        reporter->testCaseStart(tc, new_buf);
-        if (!list_test_cases) {
-            std::streambuf* orig_buf = std::cerr.rdbuf();
-            std::cerr.rdbuf(&new_buf);
-            std::cerr << std::endl;
-            auto start = std::chrono::high_resolution_clock::now();
-            try {
-                tc.func(&context);  // run the test case
-            } catch (const AssertionData&) {
-            } catch (const FuzzFinishedException&) {
-            } catch (const std::exception& e) {
-                std::cerr << e.what() << std::endl;
-                if (context.failed_as == 0) {
-                    context.failed_as = 1;
-                }
+    TestHistory record;
+    std::string record_path = history_path;
+    if (record_path.empty() && (rerun_failed || changed_only)) record_path = ZEROERR_HISTORY_FILE;
+    if (!record_path.empty()) {
+        record.load(record_path);
+        history = &record;
+    }
+    if (history && !deps_path.empty()) {
+        std::vector<std::string> files;
+        findDependencyFiles(deps_path, files);
+        for (auto& file : files) history->loadDependencies(file);
+    }
+
+    std::vector<const TestCase*> tests;
+    for (TestType type : types)
+        for (auto& tc : detail::getRegisteredTests(type))
+            if (run_filter(tc)) tests.push_back(&tc);
+    if (types.size() > 1)
+        std::stable_sort(tests.begin(), tests.end(),
+                         [](const TestCase* a, const TestCase* b) { return *a < *b; });
+    // the sources are hashed before they can be edited during the run
+    if (history)
+        for (auto tc : tests) history->sourceHash(*tc);
+    if (history && (rerun_failed || changed_only)) tests = selectIncremental(*this, tests, *history);
+    if (shard_count > 1) tests = selectShard(tests, shard_index, shard_count, history);
+
+    tests.erase(std::remove_if(tests.begin(), tests.end(),
+                               [&](const TestCase* tc) {
+                                   if (!runOnExecution(*tc)) return false;
+                                   sum.skipped += 1;
+                                   return true;
+                               }),
+                tests.end());
+
+    // the logs kept for the report stay in the process of the test case, they are not isolated
+    bool sequential = list_test_cases;
+    bool isolated   = false;
+#ifdef ZEROERR_OS_UNIX
+    isolated = !sequential && !log_to_report && (isolate || isolate_each);
+#endif
+#ifndef ZEROERR_NO_THREAD_SAFE
+    // the children of --isolate watch their test cases themselves
+    std::unique_ptr<Watchdog> guard;
+    if (!isolated && !list_test_cases && timeout > 0) {
+        guard.reset(new Watchdog());
+        watchdog = guard.get();
+    }
+#endif
+#ifdef ZEROERR_OS_UNIX
+    if (isolated) {
+        long     cores     = sysconf(_SC_NPROCESSORS_ONLN);
+        unsigned processes = jobs ? jobs : static_cast<unsigned>(cores > 0 ? cores : 1);
+        runIsolated(*this, *reporter, processes, tests, sum);
+    } else
+#endif
+#ifndef ZEROERR_NO_THREAD_SAFE
+    if (!sequential && jobs != 1) {
+        unsigned threads = jobs ? jobs : std::max(1u, std::thread::hardware_concurrency());
+        runParallel(*this, *reporter, threads, tests, sum);
+    } else
+#endif
+    {
+        for (auto tc : tests) {
+            reporter->testCaseStart(*tc, new_buf);
+            if (!list_test_cases && capture_fd) {
+                runCaptured(*this, *reporter, *tc, new_buf, sum);
+            } else {
+                if (!list_test_cases) runTestCase(*this, *tc, context, new_buf);
+                reportTestCase(*this, *reporter, *tc, context, new_buf, sum);
             }
-            auto end         = std::chrono::high_resolution_clock::now();
-            context.duration = end - start;
-            std::cerr.rdbuf(orig_buf);
+            context.reset();
+            new_buf.str("");
         }
-        // Decorators may rewrite pass/fail before results are accumulated.
-        runOnFinish(tc, context);
-        int type = sum.add(context);
-        reporter->testCaseEnd(tc, new_buf, context, type);
-        context.reset();
-        new_buf.str("");
     }
+    watchdog = nullptr;
     reporter->testEnd(sum);
+    if (assertion_report > 0 && !list_test_cases) reportAssertionSites(assertion_report);
+    if (history) {
+        if (!list_test_cases) {
+            reportRegressions(*history, regression_threshold);
+            history->save(record_path);
+        }
+        history = nullptr;
+    }
     delete reporter;
     return (sum.failed > 0 || sum.failed_as > 0) ? 1 : 0;
 }
@@ -311,32 +2280,60 @@ bool TestCase::operator<(const TestCase& rhs) const {
 
 namespace detail {
 
-std::set<TestCase>& getTestSet(TestType type) {
-    static std::set<TestCase> test_set, bench_set, fuzz_set;
-    switch (type) {
-        case TestType::test_case: return test_set;
-        case TestType::bench:     return bench_set;
-        case TestType::fuzz_test: return fuzz_set;
-        case TestType::sub_case:  return test_set;
-    }
-    throw std::runtime_error("Invalid test type");
-}
-
-static std::set<TestCase> getRegisteredTests(unsigned type) {
-    std::set<TestCase> result;
-    if (type & TestType::test_case)
-        result.insert(getTestSet(test_case).begin(), getTestSet(test_case).end());
-    if (type & TestType::bench) result.insert(getTestSet(bench).begin(), getTestSet(bench).end());
-    if (type & TestType::fuzz_test)
-        result.insert(getTestSet(fuzz_test).begin(), getTestSet(fuzz_test).end());
-    return result;
+// the last registered record, the records are linked by regTest::next. It is initialized
+// before any constructor of the static records runs.
+static regTest* registered_tests = nullptr;
+
+regTest::regTest(const char* name, const char* file, unsigned line, void (*func)(TestContext*),
+                 std::vector<Decorator*> decorators, TestType type)
+    : name(name),
+      file(file),
+      line(line),
+      func(func),
+      decorators(std::move(decorators)),
+      type(type),
+      next(registered_tests) {
+    registered_tests = this;
 }
 
-regTest::regTest(const TestCase& tc, TestType type) {
-    for (auto& decorator : tc.decorators) {
-        if (decorator->onStartup(tc)) return;
-    }
-    getTestSet(type).insert(tc);
+/**
+ * @brief the registered test cases of a type, sorted by their files and lines
+ * @details The records are sorted and turned into test cases at the first call. A test case
+ * in a header included by several files is registered more than once, it is kept once.
+ */
+static const std::vector<TestCase>& getRegisteredTests(TestType type) {
+    struct Registry {
+        std::vector<TestCase> tests[3];
+        Registry() {
+            std::vector<const regTest*> records;
+            for (const regTest* r = registered_tests; r; r = r->next) records.push_back(r);
+            auto less = [](const regTest* a, const regTest* b) {
+                int order = a->file == b->file ? 0 : std::strcmp(a->file, b->file);
+                return order < 0 || (order == 0 && a->line < b->line);
+            };
+            std::sort(records.begin(), records.end(), less);
+
+            const regTest* last[3] = {};
+            for (const regTest* r : records) {
+                unsigned index = slot(r->type);
+                if (last[index] && !less(last[index], r)) continue;
+                last[index] = r;
+                TestCase tc(r->name, r->file, r->line, r->func, r->decorators);
+                if (std::none_of(tc.decorators.begin(), tc.decorators.end(),
+                                 [&](Decorator* d) { return d->onStartup(tc); }))
+                    tests[index].push_back(std::move(tc));
+            }
+        }
+        static unsigned slot(TestType type) {
+            switch (type) {
+                case TestType::bench:     return 1;
+                case TestType::fuzz_test: return 2;
+                default:                  return 0;
+            }
+        }
+    };
+    static Registry registry;
+    return registry.tests[Registry::slot(type)];
 }
 
 static std::set<IReporter*>& getRegisteredReporters() {
@@ -725,11 +2722,18 @@ class XmlReporter : public IReporter {
 public:
     detail::XmlWriter xml;
 
-    struct TestCaseTemp {
-        const TestCase* tc;
-    };
+    // write each field of a log message as an element
+    struct FieldWriter : FieldVisitor {
+        detail::XmlWriter& xml;
+        std::string        buffer;
 
-    std::vector<TestCaseTemp> current;
+        FieldWriter(detail::XmlWriter& xml) : xml(xml) {}
+        void visit(const std::string& name, const LogField& field) override {
+            buffer.clear();
+            field.append(buffer);
+            xml.scopedElement(name).writeText(buffer, false, false);
+        }
+    } fields{xml};
 
     virtual std::string getName() const override { return "xml"; }
 
@@ -743,18 +2747,15 @@ public:
     }
 
     virtual void testCaseStart(const TestCase& tc, std::stringbuf&) override {
-        current.push_back({&tc});
         xml.startElement("TestCase")
             .writeAttribute("name", tc.name)
             .writeAttribute("filename", tc.file)
             .writeAttribute("line", tc.line)
             .writeAttribute("skipped", "false");
-        if (ut.log_to_report) suspendLog();
     }
 
     virtual void testCaseEnd(ZEROERR_UNUSED(const TestCase&), std::stringbuf& sb,
                              const TestContext& ctx, int) override {
-        current.pop_back();
         xml.scopedElement("Result")
             .writeAttribute("time", 0)
             .writeAttribute("passed", ctx.passed)
@@ -768,10 +2769,10 @@ public:
             .writeAttribute("skipped", ctx.skipped_as);
         xml.scopedElement("Output").writeText(sb.str());
 
-        if (ut.log_to_report) {
+        if (ctx.log) {
             xml.startElement("Log");
-            LogIterator begin = LogStream::getDefault().begin();
-            LogIterator end   = LogStream::getDefault().end();
+            LogIterator begin = ctx.log->begin();
+            LogIterator end   = ctx.log->end();
             for (auto p = begin; p != end; ++p) {
                 xml.startElement("LogEntry")
                     .writeAttribute("function", p->info->function)
@@ -779,13 +2780,10 @@ public:
                     .writeAttribute("message", p->info->message)
                     .writeAttribute("category", p->info->category)
                     .writeAttribute("severity", p->info->severity);
-                for (auto pair : p->getData()) {
-                    xml.scopedElement(pair.first).writeText(pair.second, false, false);
-                }
+                p->visit(fields);
                 xml.endElement();
             }
             xml.endElement();
-            resumeLog();
         }
         xml.endElement();
     }
@@ -838,6 +2836,8 @@ public:
     TimeoutDecorator() : timeout(0) {}
     TimeoutDecorator(float timeout) : timeout(timeout) {}
 
+    double limit() const { return timeout; }
+
     bool onFinish(const TestCase&, TestContext& ctx) override {
         if (ctx.duration > std::chrono::duration<double>(timeout)) {
             std::cerr << FgRed <<  "Timeout: " << Reset << ctx.duration.count() << "s > " << timeout << "s" << std::endl;
@@ -855,6 +2855,18 @@ Decorator* timeout(float timeout) {
     return &timeout_dec[timeout];
 }
 
+// the time limit of a test case in seconds, the smaller of its timeout() decorator and
+// --timeout, 0 for none. The watchdog of an isolated child stops it at --timeout, so the parent
+// must not wait for a larger decorator.
+static double timeLimit(const UnitTest& ut, const TestCase& tc) {
+    double result = ut.timeout;
+    for (auto decorator : tc.decorators)
+        if (auto limit = dynamic_cast<const TimeoutDecorator*>(decorator))
+            if (limit->limit() > 0 && (result <= 0 || limit->limit() < result))
+                result = limit->limit();
+    return result;
+}
+
 class FailureDecorator : public Decorator {
 public:
     enum FailureType { may_fail, should_fail };
@@ -903,6 +2915,14 @@ Decorator* should_fail(bool isShouldFail) {
     return nullptr;
 }
 
+// serial() only marks the test case, it is checked by the parallel runner
+class SerialDecorator : public Decorator {};
+
+Decorator* serial(bool isSerial) {
+    static SerialDecorator serial_dec;
+    if (isSerial) return &serial_dec;
+    return nullptr;
+}
 
 }  // namespace zeroerr
 
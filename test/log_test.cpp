@@ -2,10 +2,14 @@
 #define ZEROERR_ENABLE_SPEED_TEST
 
 #include "zeroerr/log.h"
+#include "zeroerr/logfile.h"
 #include "zeroerr/assert.h"
 #include "zeroerr/benchmark.h"
 #include "zeroerr/unittest.h"
 
+#include <fstream>
+#include <thread>
+
 #ifdef ZEROERR_ENABLE_SPEED_TEST
 #include "spdlog/spdlog.h"
 #endif
@@ -167,6 +171,90 @@ TEST_CASE("access log in Test case") {
     zeroerr::resumeLog();
 }
 
+TEST_CASE("log capture scope") {
+    zeroerr::LogCaptureScope outer;
+    LOG("outer {i}", 1);
+    {
+        zeroerr::LogCaptureScope inner;
+        CHECK(&zeroerr::LogStream::getDefault() == &inner.stream());
+        LOG("inner {i}", 2);
+
+        int n = 0;
+        for (auto p = inner.stream().begin(); p != inner.stream().end(); ++p) {
+            CHECK(p.get<int>("i") == 2);
+            n++;
+        }
+        CHECK(n == 1);
+    }
+    CHECK(&zeroerr::LogStream::getDefault() == &outer.stream());
+
+    // other threads still log to the global stream
+    zeroerr::LogStream* other = nullptr;
+    std::thread([&] { other = &zeroerr::LogStream::getDefault(); }).join();
+    CHECK(other != &outer.stream());
+
+    int n = 0;
+    for (auto p = outer.stream().begin("outer"); p != outer.stream().end(); ++p) n++;
+    CHECK(n == 1);
+
+    zeroerr::LogCaptureScope empty;
+    CHECK((empty.stream().begin() == empty.stream().end()));
+}
+
+TEST_CASE("deferred dbg") {
+    zeroerr::LogCaptureScope capture;
+    int                      x = 1;
+    for (int i = 0; i < 2; i++) CHECK(ZEROERR_DBG_LOG(x, x + i) == 1 + i);
+    CHECK(ZEROERR_DBG_LOG(std::string("{}")) == "{}");
+
+    std::vector<std::string> lines;
+    for (auto p = capture.stream().begin(); p != capture.stream().end(); ++p) {
+        lines.push_back(p->str());
+        if (lines.size() <= 2) CHECK(p.get<int>("x + i") == static_cast<int>(lines.size()));
+    }
+    REQUIRE(lines.size() == 3);
+    CHECK(lines[0] == "x, x + i = 1 1 (int, int)");
+    CHECK(lines[1] == "x, x + i = 1 2 (int, int)");
+    CHECK(lines[2].find("std::string(\"()\") = {} (") == 0);
+}
+
+bool production_check(int a, int b);
+bool production_check_eq(int a, int b);
+bool production_require(int a);
+int  production_sampled(double rate, int n);
+
+TEST_CASE("production assertions") {
+    zeroerr::LogCaptureScope capture;
+    CHECK(production_check(1, 2));
+    CHECK(production_check_eq(1, 2));
+    CHECK((capture.stream().begin() == capture.stream().end()));
+
+    CHECK_NOT(production_check(2, 1));
+    CHECK_NOT(production_check_eq(2, 2));
+    CHECK_THROWS(production_require(0));
+
+    std::vector<std::string> conds, exprs;
+    for (auto p = capture.stream().begin(); p != capture.stream().end(); ++p) {
+        conds.push_back(p.get<const char*>("cond"));
+        exprs.push_back(p.get<std::string>("expr"));
+    }
+    REQUIRE(conds.size() == 3);
+    CHECK(conds[0] == std::string("a < b"));
+    CHECK(exprs[0] == "2 < 1");
+    CHECK(conds[1] == std::string("a + 1 == b"));
+    CHECK(exprs[1] == "3 == 2");
+    CHECK(exprs[2] == "0 > 0");
+    CHECK(capture.stream().begin().get<int>("a") == 2);
+}
+
+TEST_CASE("sampled assertions") {
+    CHECK(production_sampled(1, 1000) == 1000);
+    CHECK(production_sampled(0, 1000) == 0);
+    int n = production_sampled(0.25, 10000);
+    CHECK(n > 2000);
+    CHECK(n < 3000);
+}
+
 TEST_CASE("iterate log stream", skip()) {
     zeroerr::suspendLog();
     function();
@@ -209,4 +297,213 @@ TEST_CASE("log to dir") {
     LOG("log to dir {i}", 1);
     WARN("warn log to dir {i}", 2);
     zeroerr::LogStream::getDefault().setStderrLogger();
-}
\ No newline at end of file
+}
+
+static void traced_function(int i) {
+    TRACE_SCOPE("traced function {i}", i);
+    LOG("inside traced function {i}", i);
+}
+
+TEST_CASE("trace scope") {
+    zeroerr::LogStream::getDefault().setTraceLogger("trace.json");
+    zeroerr::suspendLog();
+    {
+        TRACE_SCOPE("trace scope test");
+        for (int i = 0; i < 3; ++i) traced_function(i);
+    }
+    zeroerr::resumeLog();
+    zeroerr::LogStream::getDefault().setStderrLogger();
+
+    std::ifstream     file("trace.json");
+    std::stringstream ss;
+    ss << file.rdbuf();
+    std::string trace = ss.str();
+
+    auto count = [&](const std::string& pattern) {
+        int n = 0;
+        for (size_t p = trace.find(pattern); p != std::string::npos; p = trace.find(pattern, p + 1))
+            n++;
+        return n;
+    };
+    CHECK(count("\"ph\":\"B\"") == 4);
+    CHECK(count("\"ph\":\"E\"") == 4);
+    CHECK(count("\"ph\":\"i\"") == 3);
+    CHECK(count("\"args\":{\"i\":\"2\"}") == 2);
+    CHECK(trace.back() == '\n');
+}
+
+TEST_CASE("binary log file") {
+    auto start = std::chrono::system_clock::now(), middle = start;
+    {
+        zeroerr::LogStream stream;
+        stream.setBinaryLogger("log.bin", 2);
+        for (int i = 0; i < 200; ++i) {
+            if (i == 100) middle = std::chrono::system_clock::now();
+            LOG("binary log {i} {name}", stream, i, "abc");
+            if (i % 50 == 0) WARN("binary warn {i}", stream, i);
+        }
+    }
+    auto stop = std::chrono::system_clock::now();
+
+    zeroerr::LogFileReader reader("log.bin");
+    CHECK(reader.sites().size() == 2);
+
+    int n = 0;
+    for (auto p = reader.begin(); p != reader.end(); ++p) n++;
+    CHECK(n == 204);
+
+    n = 0;
+    for (auto p = reader.begin("binary warn"); p != reader.end(); ++p) {
+        CHECK(p->get("i").str() == std::to_string(n * 50));
+        CHECK(p->str() == "binary warn " + std::to_string(n * 50));
+        n++;
+    }
+    CHECK(n == 4);
+
+    n = 0;
+    for (auto p = reader.begin(start, stop); p != reader.end(); ++p) n++;
+    CHECK(n == 204);
+
+    n = 0;
+    for (auto p = reader.begin(middle, stop); p != reader.end(); ++p) {
+        CHECK((p->time() >= middle));
+        n++;
+    }
+    CHECK(n == 102);
+    auto later = reader.begin(stop + std::chrono::seconds(1), stop + std::chrono::seconds(2));
+    CHECK((later == reader.end()));
+}
+
+#ifndef _WIN32
+TEST_CASE("shared memory log ring") {
+    zeroerr::LogStream stream;
+    stream.setSharedMemoryLogger("zeroerr_test_ring", 4096);
+    zeroerr::LogRingReader reader("zeroerr_test_ring");
+
+    int n = 0;
+    for (int round = 0; round < 3; ++round) {
+        for (int i = 0; i < 20; ++i) LOG("ring {i} {name} {ok}", stream, i, "abc", i % 2 == 0);
+        for (auto p = reader.peek(); p.valid(); p = reader.peek()) {
+            CHECK(p.str() == "ring " + std::to_string(n % 20) + " abc " +
+                                 (n % 2 == 0 ? "true" : "false"));
+            CHECK(p.type(0) == zeroerr::INT_f);
+            CHECK(p.get("name") == "abc");
+            n++;
+            reader.pop();
+        }
+    }
+    CHECK(n == 60);
+    CHECK(reader.dropped() == 0);
+    CHECK(reader.sites().size() == 1);
+
+    // the producer drops messages instead of overwriting unread ones
+    for (int i = 0; i < 1000; ++i) LOG("ring {i} {name} {ok}", stream, i, "abc", true);
+    CHECK(reader.dropped() > 0);
+    n = 0;
+    for (auto p = reader.peek(); p.valid(); p = reader.peek()) {
+        CHECK(p.get("i") == std::to_string(n++));
+        reader.pop();
+    }
+    CHECK(n + reader.dropped() == 1000);
+
+    // another producer of the same name creates a new ring, the mapped one is not truncated
+    zeroerr::LogStream other;
+    other.setSharedMemoryLogger("zeroerr_test_ring", 4096);
+    LOG("ring {i} {name} {ok}", stream, 7, "abc", true);
+    auto p = reader.peek();
+    REQUIRE(p.valid());
+    CHECK(p.get("i") == "7");
+    CHECK(zeroerr::LogRingReader("zeroerr_test_ring").sites().empty());
+}
+#endif
+
+TEST_CASE("log buffer callback", serial()) {
+    zeroerr::setLogCustomCallback(
+        [](const zeroerr::LogMessage& msg, bool, std::string& out) {
+            out += msg.info->short_filename;
+            out += ": ";
+            msg.str(out);
+            out += '\n';
+        });
+    {
+        zeroerr::LogStream stream;
+        stream.setFileLogger("buffer_callback.txt");
+        LOG("buffer {i} {s}", stream, 1, "abc");
+    }
+    zeroerr::setLogCustomCallback(zeroerr::LogBufferCallback(nullptr));
+
+    std::ifstream file("buffer_callback.txt");
+    std::string   line;
+    std::getline(file, line);
+    CHECK(line == "log_test.cpp: buffer 1 abc");
+}
+
+TEST_CASE("log field visitor") {
+    struct TypeVisitor : zeroerr::FieldVisitor {
+        std::map<std::string, zeroerr::FieldType> types;
+        int64_t                                   sum = 0;
+        void visit(const std::string& name, const zeroerr::LogField& field) override {
+            types[name] = field.type;
+            if (field.type == zeroerr::INT_f) sum += *static_cast<const int64_t*>(field.value);
+        }
+    } visitor;
+
+    zeroerr::LogStream stream;
+    stream.setFlushManually();
+    LOG("visit {a} {b} {c} {d} {e} {f}", stream, 1, -2L, 3u, 1.5, "str", std::vector<int>{1, 2});
+    auto msg = stream.begin();
+    msg->visit(visitor);
+
+    CHECK(visitor.sum == -1);
+    CHECK(visitor.types["a"] == zeroerr::INT_f);
+    CHECK(visitor.types["c"] == zeroerr::UINT_f);
+    CHECK(visitor.types["d"] == zeroerr::FLOAT_f);
+    CHECK(visitor.types["e"] == zeroerr::STRING_f);
+    CHECK(visitor.types["f"] == zeroerr::OTHER_f);
+
+    auto data = msg->getData();
+    CHECK(data["b"] == "-2");
+    CHECK(data["d"] == "1.5");
+    CHECK(data["e"] == "\"str\"");
+    CHECK(data["f"] == "[1, 2]");
+}
+
+TEST_CASE("report target 1") {
+    LOG("report target {i}", 1);
+    SUB_CASE("report target sub case") { LOG("report sub case {i}", 2); };
+}
+
+TEST_CASE("report target 2") { LOG("report target {i}", 3); }
+
+TEST_CASE("log to report", serial()) {
+    // each test case logs into its own stream, also when they run in parallel
+    std::stringbuf  xml;
+    std::streambuf* orig   = std::cout.rdbuf(&xml);
+    const char*     argv[] = {"unittest", "--reporters=xml", "--log-to-report", "--jobs=2",
+                              "--testcase=report target.*"};
+    UnitTest().parseArgs(5, argv).run();
+    std::cout.rdbuf(orig);
+
+    std::string report = xml.str();
+    size_t      first  = report.find("name=\"report target 1\"");
+    size_t      sub    = report.find("name=\"report target sub case\"");
+    size_t      second = report.find("name=\"report target 2\"");
+    REQUIRE(first < sub);
+    REQUIRE(sub < second);
+
+    // the logs of a test case follow its sub cases
+    size_t log1 = report.find("<i>1</i>");
+    size_t log2 = report.find("<i>2</i>");
+    size_t log3 = report.find("<i>3</i>");
+    CHECK(sub < log2);
+    CHECK(log2 < log1);
+    CHECK(log1 < second);
+    CHECK(second < log3);
+    CHECK(log3 != std::string::npos);
+
+    int entries = 0;
+    for (size_t p = report.find("<LogEntry"); p != std::string::npos;
+         p        = report.find("<LogEntry", p + 1))
+        entries++;
+    CHECK(entries == 3);
+}
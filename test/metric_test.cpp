@@ -0,0 +1,68 @@
+#include "zeroerr/metric.h"
+#include "zeroerr/assert.h"
+#include "zeroerr/unittest.h"
+
+#include <fstream>
+#include <thread>
+#include <vector>
+
+using namespace zeroerr;
+
+
+static void handle_request(int size) {
+    ZEROERR_COUNTER("test_requests_total");
+    ZEROERR_COUNTER("test_bytes_total", size);
+    ZEROERR_GAUGE("test_last_size", size);
+    ZEROERR_HISTOGRAM("test_size", size);
+}
+
+static std::string read_file(const char* name) {
+    std::ifstream     file(name);
+    std::stringstream ss;
+    ss << file.rdbuf();
+    return ss.str();
+}
+
+TEST_CASE("metric histogram bucket") {
+    CHECK(Metric::bucket_index(0) == 0);
+    CHECK(Metric::bucket_index(-1) == 0);
+    for (double v : {0.01, 0.3, 1.0, 1.1, 3.0, 100.0, 12345.6}) {
+        unsigned i = Metric::bucket_index(v);
+        CHECK(Metric::bucket_upper_bound(i - 1) < v);
+        CHECK(v <= Metric::bucket_upper_bound(i));
+        CHECK(Metric::bucket_upper_bound(i) <= v * 1.25);
+    }
+    CHECK(Metric::bucket_index(1e100) == Metric::buckets - 1);
+}
+
+TEST_CASE("metric snapshot") {
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t)
+        threads.emplace_back([] {
+            for (int i = 1; i <= 100; ++i) handle_request(i);
+        });
+    for (auto& t : threads) t.join();
+
+    LogStream stream;
+    stream.setMetricsLogger("metrics.txt");
+    writeMetrics(stream);
+
+    std::string text = read_file("metrics.txt");
+    CHECK(text.find("# TYPE test_requests_total counter\ntest_requests_total 400\n") !=
+          std::string::npos);
+    CHECK(text.find("test_bytes_total 20200\n") != std::string::npos);
+    CHECK(text.find("test_last_size 100\n") != std::string::npos);
+    CHECK(text.find("# TYPE test_size histogram\n") != std::string::npos);
+    CHECK(text.find("test_size_bucket{le=\"1\"} 4\n") != std::string::npos);
+    CHECK(text.find("test_size_bucket{le=\"+Inf\"} 400\ntest_size_sum 20200\ntest_size_count 400\n") !=
+          std::string::npos);
+}
+
+TEST_CASE("metric exporter") {
+    startMetricsExporter("metrics_exporter.txt", 60);
+    ZEROERR_COUNTER("test_exported_total", 3);
+    stopMetricsExporter();
+
+    std::string text = read_file("metrics_exporter.txt");
+    CHECK(text.find("test_exported_total 3\n") != std::string::npos);
+}
@@ -10,6 +10,7 @@
 #include <iostream>
 #include <map>
 #include <memory>
+#include <thread>
 #include <tuple>
 #include <vector>
 
@@ -103,4 +104,66 @@ TEST_CASE("print in stream") {
     Printer print;
     print.isCompact = true;
     std::cerr << "map: " << print(bar) << std::endl;
-}
\ No newline at end of file
+}
+
+TEST_CASE("print into a buffer") {
+    std::string out = "v: ";
+    Printer     print(out);
+    print.isCompact  = true;
+    print.line_break = "";
+    // the values are not copied, a unique_ptr can be printed without moving it
+    std::unique_ptr<int>          up;
+    std::vector<std::vector<int>> nested{{1, 2}, {3}};
+    print(nested);
+    print(up);
+    CHECK(out == "v: [[1, 2], [3]]nullptr");
+
+    const char str[] = "abc";
+    Printer    local;
+    local.line_break = "";
+    CHECK(local(str).str() == "\"abc\"");
+    CHECK(local(1, 2).str() == "1 2");
+
+    Printer copy = local;
+    copy(3);
+    CHECK(copy.str() == "3");
+    CHECK(local.str() == "1 2");
+}
+
+TEST_CASE("cached type names") {
+    std::vector<int> v;
+    const char*      name = Printer::typeName(v);
+    CHECK(std::string(name).find("std::vector<int") == 0);
+    CHECK(Printer::typeName(std::vector<int>()) == name);
+
+    const char* other = nullptr;
+    std::thread t([&] { other = Printer::typeName(v); });
+    t.join();
+    CHECK(other == name);
+    CHECK(Printer::type(1) == "int");
+    CHECK(Printer::type(v) == name);
+}
+
+TEST_CASE("format") {
+    CHECK(format("a {x} b {y} c", 1, -2) == "a 1 b -2 c");
+    CHECK(format("{a} {b} {c}", INT64_MIN, 18446744073709551615ull, 0) ==
+          "-9223372036854775808 18446744073709551615 0");
+    CHECK(format("{a} {b} {c}", 1.5, 0.1f, 1e20) == "1.5 0.1 1e+20");
+    CHECK(format("{a} {b} {c}", true, "str", std::string("s")) == "true str s");
+    CHECK(format("{a} {b}", 'c', std::vector<int>{1, 2}) == "'c' [1, 2]");
+    CHECK(format("{missing}") == "");
+    CHECK(format("no args") == "no args");
+
+    std::string out = "prefix ";
+    format_to(out, "{i}", 42);
+    CHECK(out == "prefix 42");
+
+    static_assert(detail::fmt_count("a {x} b {y} c") == 2, "two placeholders");
+    static_assert(detail::fmt_count("{} } {unclosed") == 2, "an unclosed brace is not counted");
+    CHECK(format(ZEROERR_FMT("a {x} b {y} c"), 1, -2) == "a 1 b -2 c");
+    CHECK(format(ZEROERR_FMT("{a}{b}"), "str", std::vector<int>{1, 2}) == "str[1, 2]");
+    CHECK(format(ZEROERR_FMT("no args")) == "no args");
+    CHECK(format(ZEROERR_FMT("{x} } {unclosed"), 1, 2) == "1 2 ");
+    format_to(out, ZEROERR_FMT(" {n}"), 1.5);
+    CHECK(out == "prefix 42 1.5");
+}
@@ -0,0 +1,18 @@
+// The functions in this file are built in the production assertion mode, they are
+// tested by the test cases in log_test.cpp.
+#define ZEROERR_PRODUCTION_ASSERT
+
+#include "zeroerr/log.h"
+#include "zeroerr/assert.h"
+
+bool production_check(int a, int b) { return CHECK(a < b, " a={a}", a); }
+
+bool production_check_eq(int a, int b) { return CHECK_EQ(a + 1, b); }
+
+bool production_require(int a) { return REQUIRE(a > 0); }
+
+int production_sampled(double rate, int n) {
+    int evaluated = 0;
+    for (int i = 0; i < n; ++i) CHECK_SAMPLED(rate, (evaluated++, true));
+    return evaluated;
+}
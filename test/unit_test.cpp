@@ -3,9 +3,24 @@
 #include "zeroerr/dbg.h"
 #include "zeroerr/print.h"
 #include "zeroerr/unittest.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <set>
+#include <sstream>
 #include <string>
 #include <thread>
 
+#ifdef ZEROERR_OS_UNIX
+#include <unistd.h>
+#endif
+
 using namespace zeroerr;
 
 class A {
@@ -34,7 +49,8 @@ TEST_CASE("test class A") {
 }
 
 
-TEST_CASE("test function B") {
+// it uses the objects collected by "test class A"
+TEST_CASE("test function B", serial()) {
     std::cerr << "sizeof(A): " << collectA.objects.size() << std::endl;
     for (auto& a : collectA.objects) {
         for (int b : {1, 2, 5}) {
@@ -101,6 +117,379 @@ TEST_CASE("test sub cases") {
 }
 
 
+// the xml report of a nested run
+static std::string xmlReport(std::vector<const char*> args) {
+    std::stringbuf  xml;
+    std::streambuf* orig = std::cout.rdbuf(&xml);
+    args.insert(args.begin(), {"unittest", "--reporters=xml"});
+    UnitTest().parseArgs(static_cast<int>(args.size()), args.data()).run();
+    std::cout.rdbuf(orig);
+    return xml.str();
+}
+
+static std::atomic<int> parallel_runs(0);
+
+// the first target finishes last, the report keeps the order of registration
+TEST_CASE("parallel target 1") {
+    parallel_runs++;
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    std::cerr << "output of target 1" << std::endl;
+    SUB_CASE("sub case") { CHECK(1 == 1); };
+}
+
+TEST_CASE("parallel target 2") {
+    parallel_runs++;
+    std::cerr << "output of target 2" << std::endl;
+    CHECK(2 == 2);
+}
+
+// the targets are also run by the outer runner, so it is not run with them
+TEST_CASE("parallel test cases", serial()) {
+    int         before = parallel_runs;
+    std::string report = xmlReport({"--jobs=4", "--testcase=parallel target.*"});
+    CHECK(parallel_runs - before == 2);
+    CHECK(report.find("failures=\"0\" tests=\"2\"") != std::string::npos);
+
+    size_t first   = report.find("<TestCase name=\"parallel target 1\"");
+    size_t sub     = report.find("<TestCase name=\"sub case\"");
+    size_t output1 = report.find("output of target 1");
+    size_t second  = report.find("<TestCase name=\"parallel target 2\"");
+    size_t output2 = report.find("output of target 2");
+    CHECK(first < sub);
+    CHECK(sub < output1);
+    CHECK(output1 < second);
+    CHECK(second < output2);
+    CHECK(output2 != std::string::npos);
+    CHECK(report.find("output of target", output2 + 1) == std::string::npos);
+}
+
+
+// the targets crash only in the children of the nested run
+static bool crash_targets = false;
+
+TEST_CASE("isolated target 1") {
+    if (!crash_targets) return;
+    std::cerr << "before the crash" << std::endl;
+    std::raise(SIGSEGV);
+}
+
+TEST_CASE("isolated target 2") {
+    if (crash_targets) std::abort();
+}
+
+TEST_CASE("isolated target 3") { CHECK(3 == 3); }
+
+#ifdef ZEROERR_OS_UNIX
+TEST_CASE("isolated test cases", serial()) {
+    std::stringbuf  xml;
+    std::streambuf* orig   = std::cout.rdbuf(&xml);
+    const char*     argv[] = {"unittest", "--isolate", "--jobs=2", "--reporters=xml",
+                              "--testcase=isolated target.*"};
+    crash_targets          = true;
+    int result             = UnitTest().parseArgs(5, argv).run();
+    crash_targets          = false;
+    std::cout.rdbuf(orig);
+
+    std::string report = xml.str();
+    CHECK(result == 1);
+    CHECK(report.find("Crashed: SIGSEGV") != std::string::npos);
+    CHECK(report.find("before the crash") < report.find("Crashed: SIGSEGV"));
+    CHECK(report.find("Crashed: SIGABRT") != std::string::npos);
+    CHECK(report.find("failures=\"2\" tests=\"3\"") != std::string::npos);
+}
+#endif
+
+
+// the number of the test cases run by a nested run, from the xml report
+static int countTestCases(std::vector<const char*> args) {
+    std::string report = xmlReport(args);
+    size_t      p      = report.find("tests=\"");
+    return p == std::string::npos ? -1 : std::atoi(report.c_str() + p + 7);
+}
+
+// the exit code of a nested run
+static int exitCode(std::vector<const char*> args) {
+    args.insert(args.begin(), "unittest");
+    return UnitTest().parseArgs(static_cast<int>(args.size()), args.data()).run();
+}
+
+TEST_CASE("test shards", serial()) {
+    const char* filter = "--testcase=isolated target.*";
+    CHECK(countTestCases({filter, "--shard-count=2", "--shard-index=0"}) == 2);
+    CHECK(countTestCases({filter, "--shard-count=2", "--shard-index=1"}) == 1);
+
+    // the longest test case takes a shard alone, each shard has its own copy of the history
+    auto shard = [&](const char* count, const char* index) {
+        {
+            std::ofstream file("shard_history.txt");
+            file << __FILE__ << "\tisolated target 1\t3\n";
+            file << __FILE__ << "\tisolated target 2\t2\n";
+            file << __FILE__ << "\tisolated target 3\t2\n";
+        }
+        return countTestCases({filter, "--history=shard_history.txt", count, index});
+    };
+    CHECK(shard("--shard-count=2", "--shard-index=0") == 1);
+    CHECK(shard("--shard-count=2", "--shard-index=1") == 2);
+    CHECK(shard("--shard-count=3", "--shard-index=2") == 1);
+}
+
+TEST_CASE("bad shard options") {
+    CHECK(exitCode({"--shard-count=2", "--shard-index=7"}) == 2);
+    CHECK(exitCode({"--shard-count=2", "--shard-index=2"}) == 2);
+    CHECK(exitCode({"--shard-count=0"}) == 2);
+    CHECK(exitCode({"--shard-index=1"}) == 2);
+}
+
+TEST_CASE("bad numeric options") {
+    CHECK(exitCode({"--jobs=abc"}) == 2);
+    CHECK(exitCode({"--jobs=-1"}) == 2);
+    CHECK(exitCode({"--jobs=1.5"}) == 2);
+    CHECK(exitCode({"--jobs="}) == 2);
+    CHECK(exitCode({"--assertion-report=ten"}) == 2);
+    CHECK(exitCode({"--shard-index=x", "--shard-count=2"}) == 2);
+    CHECK(exitCode({"--shard-count=2x"}) == 2);
+    CHECK(exitCode({"--regression-threshold=-0.5"}) == 2);
+    CHECK(exitCode({"--regression-threshold=nan"}) == 2);
+    CHECK(exitCode({"--timeout=-1"}) == 2);
+    CHECK(exitCode({"--timeout=nan"}) == 2);
+    CHECK(exitCode({"--timeout=inf"}) == 2);
+    CHECK(exitCode({"--timeout= 1"}) == 2);
+}
+
+
+TEST_CASE("filter test cases", serial()) {
+    CHECK(countTestCases({"--testcase=isolated target [12]"}) == 2);
+    CHECK(countTestCases({"--testcase=isolated\\s+target \\d"}) == 3);
+    CHECK(countTestCases({"--testcase=isolated target.?"}) == 0);
+    CHECK(countTestCases({"--testcase=isolated target [^1]"}) == 2);
+    CHECK(countTestCases({"--testcase=isolated (target|none) 3"}) == 1);
+    CHECK(countTestCases({"--testcase=isolated target.*", "--testcase-exclude=.*[13]"}) == 1);
+    CHECK(countTestCases({"--testcase=isolated target.*", "--file=.*unit_test\\.cpp"}) == 3);
+    CHECK(countTestCases({"--testcase=isolated target.*", "--file=.*log_test.cpp"}) == 0);
+}
+
+
+// the targets print only in the nested runs
+static bool print_targets = false;
+
+TEST_CASE("capture target printf") {
+    if (!print_targets) return;
+    printf("from printf\n");
+    CHECK(std::system("echo from child") == 0);
+}
+
+TEST_CASE("capture target long") {
+    if (!print_targets) return;
+    std::string line(1023, 'x');
+    for (int i = 0; i < 4096; ++i) std::cerr << line << '\n';
+    std::cerr << "the last line" << std::endl;
+}
+
+#ifdef ZEROERR_OS_UNIX
+TEST_CASE("capture file descriptors", serial()) {
+    print_targets      = true;
+    std::string report = xmlReport({"--capture-fd", "--testcase=capture target printf"});
+    print_targets      = false;
+    CHECK(report.find("from printf") != std::string::npos);
+    CHECK(report.find("from child") != std::string::npos);
+}
+#endif
+
+TEST_CASE("capture long output", serial()) {
+    print_targets      = true;
+    std::string report = xmlReport({"--testcase=capture target long"});
+    print_targets      = false;
+    CHECK(report.size() < 2 * 1024 * 1024);
+    CHECK(report.find("bytes omitted") != std::string::npos);
+    CHECK(report.find("the last line") != std::string::npos);
+
+#ifdef ZEROERR_OS_UNIX
+    // the whole output is kept in a file
+    const std::string prefix = "the whole output is in ";
+    size_t            begin  = report.find(prefix) + prefix.size();
+    std::string       path   = report.substr(begin, report.find(" ...", begin) - begin);
+    std::ifstream     file(path, std::ios::binary | std::ios::ate);
+    CHECK(file.tellg() > std::streampos(4096 * 1024));
+    file.close();
+    std::remove(path.c_str());
+
+    // with --capture-fd the capture file itself keeps the whole output
+    print_targets = true;
+    report        = xmlReport({"--capture-fd", "--testcase=capture target long"});
+    print_targets = false;
+    CHECK(report.size() < 2 * 1024 * 1024);
+    CHECK(report.find("the last line") != std::string::npos);
+    begin = report.find(prefix) + prefix.size();
+    path  = report.substr(begin, report.find(" ...", begin) - begin);
+    file.open(path, std::ios::binary | std::ios::ate);
+    CHECK(file.tellg() > std::streampos(4096 * 1024));
+    file.seekg(-14, std::ios::end);
+    std::string last(14, '\0');
+    file.read(&last[0], 14);
+    CHECK(last == "the last line\n");
+    file.close();
+    std::remove(path.c_str());
+#endif
+}
+
+
+// the targets hang only in the nested runs
+static bool hang_targets = false;
+
+TEST_CASE("timeout target 1", timeout(0.2f)) {
+    if (hang_targets) std::this_thread::sleep_for(std::chrono::seconds(30));
+}
+
+TEST_CASE("timeout target 2") {
+    if (hang_targets) std::this_thread::sleep_for(std::chrono::seconds(30));
+}
+
+// --timeout is smaller, it stops the test case
+TEST_CASE("timeout target 3", timeout(60.0f)) {
+    if (hang_targets) std::this_thread::sleep_for(std::chrono::seconds(30));
+}
+
+#ifdef ZEROERR_OS_UNIX
+TEST_CASE("watchdog", serial()) {
+    // the watchdog of a child prints the backtraces to its stderr
+    fflush(stderr);
+    int   err = dup(2);
+    FILE* log = fopen("watchdog_stderr.txt", "w+");
+    dup2(fileno(log), 2);
+
+    auto start         = std::chrono::steady_clock::now();
+    hang_targets       = true;
+    std::string report = xmlReport({"--isolate", "--jobs=3", "--timeout=0.2",
+                                    "--testcase=timeout target.*"});
+    hang_targets       = false;
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    dup2(err, 2);
+    close(err);
+    fclose(log);
+    CHECK(elapsed.count() < 10);
+    CHECK(report.find("failures=\"3\" tests=\"3\"") != std::string::npos);
+    CHECK(report.find("Crashed: ") == std::string::npos);
+    size_t timeouts = 0;
+    for (size_t p = report.find("Timeout: "); p != std::string::npos;
+         p        = report.find("Timeout: ", p + 1))
+        timeouts++;
+    CHECK(timeouts == 3);
+
+    std::ifstream     file("watchdog_stderr.txt");
+    std::stringstream errors;
+    errors << file.rdbuf();
+    CHECK(errors.str().find("Timeout: timeout target 1") != std::string::npos);
+    CHECK(errors.str().find("Timeout: timeout target 2") != std::string::npos);
+    CHECK(errors.str().find("Timeout: timeout target 3") != std::string::npos);
+#if defined(__linux__) && defined(__GLIBC__)
+    CHECK(errors.str().find("(running the test case)") != std::string::npos);
+#endif
+}
+#endif
+
+
+// the assertions of the worker threads fail only in the nested runs
+static bool thread_targets = false;
+
+TEST_CASE("thread target check") {
+    std::vector<std::thread> workers;
+    for (int t = 0; t < 4; ++t)
+        workers.emplace_back([=] {
+            for (int i = 0; i < 1000; ++i) CHECK(i >= 0);
+            if (thread_targets) CHECK(t < 0);
+        });
+    for (auto& w : workers) w.join();
+}
+
+TEST_CASE("thread target require") {
+    std::thread worker(zeroerr::worker([=] {
+        REQUIRE(!thread_targets);
+        CHECK(true);
+    }));
+    worker.join();
+    CHECK(true);  // the failed REQUIRE of the worker stops the test case here
+}
+
+TEST_CASE("assertions in threads", serial()) {
+    thread_targets     = true;
+    std::string report = xmlReport({"--testcase=thread target.*"});
+    thread_targets     = false;
+    CHECK(report.find("<ResultAsserts passed=\"4000\" warnings=\"4\" failed=\"0\"") !=
+          std::string::npos);
+    for (const char* failure : {"0 &lt; 0", "1 &lt; 0", "2 &lt; 0", "3 &lt; 0"})
+        CHECK(report.find(failure) != std::string::npos);
+
+    // the test case stops at its next assertion after the failed REQUIRE of the worker
+    CHECK(report.find("<ResultAsserts passed=\"0\" warnings=\"0\" failed=\"1\"") !=
+          std::string::npos);
+    CHECK(report.find("failures=\"1\" tests=\"2\"") != std::string::npos);
+}
+
+TEST_CASE("history target") { std::this_thread::sleep_for(std::chrono::milliseconds(20)); }
+
+TEST_CASE("test history", serial()) {
+    {
+        std::ofstream file("test_history.txt");
+        file << __FILE__ << "\thistory target\t0.001\t4\t1\t0\t1\n";
+    }
+
+    // the report of the regressions is written to std::cerr
+    std::stringbuf  err;
+    std::streambuf* orig   = std::cerr.rdbuf(&err);
+    const char*     argv[] = {"unittest", "--history=test_history.txt", "--testcase=history target"};
+    UnitTest().parseArgs(3, argv).run();
+    std::cerr.rdbuf(orig);
+    CHECK(err.str().find("slower than the history") != std::string::npos);
+
+    std::ifstream file("test_history.txt");
+    std::string   file_name, name;
+    double        duration;
+    unsigned      runs, failures, flips, failed;
+    std::getline(file, file_name, '\t');
+    std::getline(file, name, '\t');
+    file >> duration >> runs >> failures >> flips >> failed;
+    CHECK(name == "history target");
+    CHECK(duration > 0.005);
+    CHECK(runs == 5);
+    CHECK(failures == 1);
+    CHECK(flips == 1);
+    CHECK(failed == 0);
+}
+
+TEST_CASE("rerun failed and changed test cases", serial()) {
+    const char* filter  = "--testcase=isolated target.*";
+    const char* history = "--history=rerun_history.txt";
+    {
+        std::ofstream file("rerun_history.txt");
+        file << __FILE__ << "\tisolated target 1\t0.1\t1\t1\t0\t1\n";
+    }
+    CHECK(countTestCases({filter, history, "--rerun-failed"}) == 1);
+    // all the test cases are run if none failed
+    CHECK(countTestCases({filter, history, "--rerun-failed"}) == 3);
+
+    // the hashes of the sources are recorded by the last run
+    CHECK(countTestCases({filter, history, "--changed-only"}) == 0);
+    {
+        std::ofstream file("rerun_history.txt");
+        file << __FILE__ << "\tisolated target 1\t0.1\t1\t0\t0\t0\t1\n";
+    }
+    CHECK(countTestCases({filter, history, "--changed-only"}) == 3);
+
+    // a change of an included file
+    const char* deps = "--deps=rerun_deps.d";
+    {
+        std::ofstream file("rerun_deps.d");
+        file << "unit_test.o: " << __FILE__ << " \\\n rerun_header.h\n\nrerun_header.h:\n";
+    }
+    std::ofstream("rerun_header.h") << "#define A 1\n";
+    CHECK(countTestCases({filter, history, deps, "--changed-only"}) == 3);
+    CHECK(countTestCases({filter, history, deps, "--changed-only"}) == 0);
+    std::ofstream("rerun_header.h") << "#define A 2\n";
+    CHECK(countTestCases({filter, history, deps, "--changed-only"}) == 3);
+}
+
+
 TEST_CASE("match ostream") {
     // match output can be done in the following workflow
     // 1. user mark the test case which are comparing output use 'have_same_output'
@@ -200,6 +589,152 @@ TEST_CASE("combinational test args") {
     test(a, b);
 }
 
+struct CountPrint {
+    int        v;
+    static int printed;
+    bool       operator==(const CountPrint& rhs) const { return v == rhs.v; }
+    bool       operator<(const CountPrint& rhs) const { return v < rhs.v; }
+};
+int CountPrint::printed = 0;
+
+std::ostream& operator<<(std::ostream& os, const CountPrint& c) {
+    CountPrint::printed++;
+    return os << c.v;
+}
+
+TEST_CASE("passing assertions do not print operands") {
+    CountPrint a{1}, b{1}, c{2};
+    CHECK(a == b);
+    CHECK(a < c);
+    CHECK_EQ(a, b);
+    CHECK_LT(a, c);
+    CHECK_NOT(a == c);
+    CHECK(CountPrint::printed == 0);
+
+    std::vector<int> x(1000, 1), y(1000, 1);
+    CHECK(x == y);
+    CHECK_EQ(x, y);
+}
+
+// outside a test case, a failed CHECK is not counted by the test context
+static void check_site_positive(int site_value) { CHECK(site_value > 0); }
+
+TEST_CASE("assertion site counters") {
+    for (int i = -2; i < 8; ++i) check_site_positive(i);
+
+    const zeroerr::AssertionSite* site = nullptr;
+    for (auto p : zeroerr::getAssertionSites())
+        if (p->cond == "site_value > 0") site = p;
+    REQUIRE(site != nullptr);
+    CHECK(std::string(site->file) == __FILE__);
+    uint64_t evaluations = site->evaluations, warnings = site->warnings,
+             failures = site->failures;
+    CHECK(evaluations == 10);
+    CHECK(warnings == 3);
+    CHECK(failures == 0);
+}
+
+TEST_CASE("bulk comparison") {
+    std::vector<float> a(1 << 20), b;
+    for (size_t i = 0; i < a.size(); ++i) a[i] = static_cast<float>(i) * 0.5f;
+    b = a;
+    CHECK_ARRAY_EQ(a, b);
+    CHECK_ALL_CLOSE(a, b, 0, 0);
+    CHECK_BYTES_EQ(a.data(), b.data(), a.size() * sizeof(float));
+
+    // mismatches at both sides of the vector lanes and in the scalar tail
+    size_t index[] = {3, 31, 32, 4095, (1 << 20) - 1};
+    for (size_t i : index) b[i] += 1;
+    auto r = zeroerr::detail::compareArrays(a, b);
+    CHECK_NOT(r.res);
+    CHECK(r.str() == "5 of 1048576 elements differ, first at [3] 1.5 vs 2.5, [31] 15.5 vs 16.5, "
+                     "[32] 16 vs 17, [4095] 2047.5 vs 2048.5, [1048575] 524287.5 vs 524288.5");
+    CHECK(zeroerr::detail::compareAllClose(a, b, 0, 1).res);
+    CHECK(zeroerr::detail::compareAllClose(a, b, 1e-2, 0).res == false);
+    CHECK(zeroerr::detail::compareAllClose(a, b, 1e-2, 1e-3).str().find("[3]") != std::string::npos);
+
+    std::vector<int> x(1000, 7), y(1000, 7);
+    y[999] = 8;
+    CHECK(zeroerr::detail::compareArrays(x, y).str() ==
+          "1 of 1000 elements differ, first at [999] 7 vs 8");
+    CHECK(zeroerr::detail::compareArrays(x, std::vector<int>(10)).str() == "size 1000 != 10");
+
+    std::vector<double> d(100, 1.0), e(100, 1.0);
+    for (size_t i = 0; i < 20; ++i) e[i * 5] = 2.0;
+    std::string s = zeroerr::detail::compareArrays(d, e).str();
+    CHECK(s.find("20 of 100 elements differ") == 0);
+    CHECK(s.find("[35]") != std::string::npos);
+    CHECK(s.find("[40]") == std::string::npos);
+    CHECK(s.substr(s.size() - 3) == "...");
+
+    const char p[] = "abcdef", q[] = "abcxef";
+    CHECK(zeroerr::detail::compareBytes(p, q, 6).str() ==
+          "1 of 6 elements differ, first at [3] 0x64 vs 0x78");
+
+    double nan = std::nan("");
+    double u[] = {1, nan, 1e300}, v[] = {1, nan, 1e300};
+    CHECK(zeroerr::detail::compareAllClose(u, v, 0, 0).str().find("[1]") != std::string::npos);
+    int ia[] = {1, 2, 3};
+    std::array<int, 3> ib{{1, 2, 3}};
+    CHECK_ARRAY_EQ(ia, ib);
+}
+
+// render `a == b` as a failed assertion would
+template <typename T>
+static std::string render_eq(const T& a, const T& b) {
+    return zeroerr::ExprResult(zeroerr::ExpressionDecomposer() << a == b).str();
+}
+
+TEST_CASE("container diff") {
+    std::vector<int> a(10000000);
+    for (size_t i = 0; i < a.size(); ++i) a[i] = static_cast<int>(i);
+    std::vector<int> b = a;
+    b[5]               = -1;
+    b[9000000]         = -2;
+    std::string s      = render_eq(a, b);
+    CHECK(s.find("2 of 10000000 elements differ") == 0);
+    CHECK(s.find("\n  [4] 4\n- [5] 5\n+ [5] -1\n  [6] 6") != std::string::npos);
+    CHECK(s.find("- [9000000] 9000000\n+ [9000000] -2") != std::string::npos);
+    CHECK(s.size() < 400);
+
+    // an insertion and a deletion are aligned instead of shifting all the elements
+    std::vector<int> c(a.begin(), a.begin() + 100), d = c;
+    d.insert(d.begin() + 50, 42);
+    d.erase(d.begin() + 80);
+    s = render_eq(c, d);
+    CHECK(s.find("size 100 vs 100") == 0);
+    CHECK(s.find("+ [50] 42\n  [50] 50") != std::string::npos);
+    CHECK(s.find("- [79] 79\n  [80] 80") != std::string::npos);
+    CHECK(s.find("[60]") == std::string::npos);
+
+    // the output is truncated
+    std::vector<int> e(c.size(), -1);
+    s = render_eq(c, e);
+    CHECK(s.find("(the diff is truncated after") != std::string::npos);
+    CHECK(std::count(s.begin(), s.end(), '\n') <= ZEROERR_DIFF_MAX_LINES + 1);
+
+    std::map<std::string, int> m, n;
+    for (int i = 0; i < 100; ++i) m["key" + std::to_string(i)] = i;
+    n = m;
+    n.erase("key7");
+    n["key8"]  = 0;
+    n["other"] = 1;
+    s          = render_eq(m, n);
+    CHECK(s.find("size 100 vs 100") == 0);
+    CHECK(s.find("\n- \"key7\" : 7") != std::string::npos);
+    CHECK(s.find("\n- \"key8\" : 8\n+ \"key8\" : 0") != std::string::npos);
+    CHECK(s.find("\n+ \"other\" : 1") != std::string::npos);
+
+    std::set<int> x(a.begin(), a.begin() + 20), y = x;
+    y.erase(3);
+    s = render_eq(x, y);
+    CHECK(s == "size 20 vs 19\n- 3");
+
+    // small containers are printed as they are
+    std::vector<int> f = {1, 2, 3}, g = {1, 2, 4};
+    CHECK(render_eq(f, g) == "[1, 2, 3] == [1, 2, 4]");
+}
+
 TEST_CASE("check 0") {
     CHECK(0 == 1);
 }
@@ -0,0 +1,125 @@
+// zeroerr_tail attaches to the shared memory log rings written by
+// LogStream::setSharedMemoryLogger and prints the messages of all producers
+// merged by their timestamps.
+//
+// Usage: zeroerr_tail [--interval=ms] [--binary=file] ring...
+//
+// With --binary, the messages are forwarded to a binary log file instead of stdout,
+// which can be read later by LogFileReader.
+
+#include "zeroerr/log.h"
+#include "zeroerr/logfile.h"
+
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace zeroerr;
+
+static volatile std::sig_atomic_t running = 1;
+
+static void stop(int) { running = 0; }
+
+static void print_record(const LogRingRecord& record) {
+    int64_t     ns = record.nanoseconds();
+    std::time_t t  = static_cast<std::time_t>(ns / 1000000000);
+    char        buf[32];
+    std::strftime(buf, sizeof(buf), "%H:%M:%S", std::localtime(&t));
+
+    const char* severity[] = {"INFO", "LOG", "WARN", "ERROR", "FATAL"};
+    auto&       site       = record.site();
+    std::printf("[%u] %s.%06lld %s %s:%u %s\n", record.pid(), buf,
+                static_cast<long long>(ns % 1000000000 / 1000),
+                site.severity <= FATAL_l ? severity[site.severity] : "?",
+                site.filename.c_str(), site.line, record.str().c_str());
+}
+
+// the messages are forwarded with the message and fields already filled in,
+// since the log sites of the producers are not known in this process
+static void forward_record(LogStream& stream, const LogRingRecord& record) {
+    static LogInfo info{__FILE__,
+                        __func__,
+                        "[{pid}] {message}",
+                        ZEROERR_LOG_CATEGORY,
+                        __LINE__,
+                        sizeof(LogMessageImpl<unsigned, std::string>),
+                        INFO_l};
+    PushResult result = stream.push(record.pid(), record.str());
+    result.log->info  = &info;
+    result.log->time  = record.time();
+}
+
+int main(int argc, char** argv) {
+    int         interval = 10;
+    std::string binary;
+    std::vector<std::unique_ptr<LogRingReader>> readers;
+
+    for (int i = 1; i < argc; ++i) {
+        if (strncmp(argv[i], "--interval=", 11) == 0) {
+            interval = atoi(argv[i] + 11);
+        } else if (strncmp(argv[i], "--binary=", 9) == 0) {
+            binary = argv[i] + 9;
+        } else {
+            try {
+                readers.emplace_back(new LogRingReader(argv[i]));
+            } catch (const std::exception& e) {
+                std::fprintf(stderr, "%s\n", e.what());
+                return 1;
+            }
+        }
+    }
+    if (readers.empty()) {
+        std::fprintf(stderr, "Usage: %s [--interval=ms] [--binary=file] ring...\n", argv[0]);
+        return 1;
+    }
+
+    LogStream stream;
+    if (!binary.empty()) {
+        stream.setBinaryLogger(binary);
+        stream.setFlushWhenFull();
+    }
+
+    std::signal(SIGINT, stop);
+    std::signal(SIGTERM, stop);
+
+    std::vector<uint64_t> dropped(readers.size(), 0);
+    while (running) {
+        // k-way merge: always take the oldest record at the front of the rings
+        for (;;) {
+            LogRingReader* oldest = nullptr;
+            LogRingRecord  record;
+            for (auto& reader : readers) {
+                LogRingRecord r = reader->peek();
+                if (r.valid() && (!oldest || r.nanoseconds() < record.nanoseconds())) {
+                    oldest = reader.get();
+                    record = r;
+                }
+            }
+            if (!oldest) break;
+            if (binary.empty())
+                print_record(record);
+            else
+                forward_record(stream, record);
+            oldest->pop();
+        }
+
+        for (size_t i = 0; i < readers.size(); ++i) {
+            uint64_t n = readers[i]->dropped();
+            if (n != dropped[i]) {
+                std::fprintf(stderr, "[%u] %llu messages dropped\n", readers[i]->pid(),
+                             static_cast<unsigned long long>(n - dropped[i]));
+                dropped[i] = n;
+            }
+        }
+        std::fflush(stdout);
+        std::this_thread::sleep_for(std::chrono::milliseconds(interval));
+    }
+    if (!binary.empty()) stream.flush();
+    return 0;
+}